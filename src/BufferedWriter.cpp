@@ -1,60 +1,298 @@
 #include "BufferedWriter.h"
+#include "Misc.h"
 #include <QtCore/QFile>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 static const int constBufferSize=10*1024*1024;
+static const int constPipeSize=1024*1024;
+static const int constMinChunkSize=4*1024*1024;
+static const int constExtentSize=1024*1024;
+static const int constDrainInterval=10000; // Microseconds
 static bool flushed=false;
 
-CBufferedWriter::CBufferedWriter(const QString &name)
-               : itsFd("-"==name ? fileno(stdout) : open(QFile::encodeName(name).constData(), O_RDWR|O_CREAT|O_TRUNC, 0644)),
+static const long pageSize=sysconf(_SC_PAGESIZE);
+
+CBufferedWriter::CBufferedWriter(const QString &name, int64_t expectedSize, int64_t resumeAt)
+               : itsFd("-"==name ? fileno(stdout)
+                                 : open64(QFile::encodeName(name).constData(), resumeAt<0 ? O_RDWR|O_CREAT|O_TRUNC|O_LARGEFILE
+                                                                                          : O_RDWR|O_LARGEFILE, 0644)),
                  itsName(name),
+                 itsFilePos(0),
+                 itsFileEnd(0),
+                 itsPreallocated(false),
+                 itsResumed(false),
                  itsCurrentPos(0),
-                 itsBuffer(itsFd ? new unsigned char [constBufferSize] : 0L)
+                 itsBufferSize(constBufferSize),
+                 itsBuffer(0L),
+                 itsPipe(false),
+                 itsGift(false),
+                 itsPipeSlots(0),
+                 itsSlotsSpliced(0),
+                 itsCurrentChunk(-1)
 {
+    if(-1!=itsFd && resumeAt>=0)
+    {
+        struct stat64 info;
+
+        // Only a regular file, that has at least what was written before, may be resumed
+        if("-"!=name && 0==fstat64(itsFd, &info) && S_ISREG(info.st_mode) && info.st_size>=resumeAt &&
+           0==ftruncate64(itsFd, resumeAt) && resumeAt==lseek64(itsFd, resumeAt, SEEK_SET))
+        {
+            itsFilePos=itsFileEnd=resumeAt;
+            itsResumed=true;
+        }
+        else
+        {
+            if("-"!=name)
+                close(itsFd);
+            itsFd=-1;
+        }
+    }
+
+    if(-1!=itsFd && !initPipe())
+    {
+        itsBuffer=new unsigned char [constBufferSize];
+        itsPreallocated="-"!=name && Misc::preallocate(itsFd, expectedSize);
+    }
 }
 
 CBufferedWriter::~CBufferedWriter()
 {
     flush();
+    if(itsPreallocated)
+        ftruncate64(itsFd, itsFileEnd);
+    if(itsGift)
+        drain();
     if("-"!=itsName)
         close(itsFd);
-    delete itsBuffer;
+    if(itsPipe)
+    {
+        QList<Chunk>::ConstIterator it(itsChunks.begin()),
+                                    end(itsChunks.end());
+
+        // The chunks were mapped for this writer alone, so unmapping them never hands pages that the
+        // pipe may still hold back to the heap
+        for(; it!=end; ++it)
+            munmap((*it).data, itsBufferSize);
+    }
+    else
+        delete [] itsBuffer;
 }
 
 bool CBufferedWriter::write(unsigned char data)
 {
-    if(itsCurrentPos+1>=constBufferSize && !flush())
+    if(itsCurrentPos>=itsBufferSize && !flush())
         return false;
     itsBuffer[itsCurrentPos++]=data;
     return true;
 }
 
+//
+// The buffer is always filled before being written, so that (other than the last) every write is
+// of the full buffer size, and hence lands on a large extent boundary.
 bool CBufferedWriter::write(unsigned char *data, unsigned int size)
 {
-    if(itsCurrentPos+size>=constBufferSize && !flush())
-        return false;
+    while(size)
+    {
+        unsigned int space=itsBufferSize-itsCurrentPos,
+                     len=size<space ? size : space;
+
+        memcpy(&itsBuffer[itsCurrentPos], data, len);
+        itsCurrentPos+=len;
+        data+=len;
+        size-=len;
+
+        if(itsCurrentPos==itsBufferSize && !flush())
+            return false;
+    }
+    return true;
+}
+
+//
+// If there is not enough space left, then only the extent aligned part of the buffer is written -
+// the remainder is moved to the start of the buffer.
+unsigned char * CBufferedWriter::reserve(unsigned int size)
+{
+    if(size>itsBufferSize-(itsPipe ? 0 : constExtentSize))
+        return 0L;
 
-    if(size>constBufferSize)
-        return size==::write(itsFd, data, size);
+    if(itsCurrentPos+size>itsBufferSize)
+    {
+        if(itsPipe)
+        {
+            if(!splice())
+                return 0L;
+        }
+        else
+        {
+            unsigned int aligned=(itsCurrentPos/constExtentSize)*constExtentSize;
 
-    memcpy(&itsBuffer[itsCurrentPos], data, size);
+            if(!writeBuffer(aligned))
+                return 0L;
+            memmove(itsBuffer, &itsBuffer[aligned], itsCurrentPos-aligned);
+            itsCurrentPos-=aligned;
+        }
+    }
+    return &itsBuffer[itsCurrentPos];
+}
+
+bool CBufferedWriter::commit(unsigned int size)
+{
+    if(itsCurrentPos+size>itsBufferSize)
+        return false;
     itsCurrentPos+=size;
     return true;
 }
 
 bool CBufferedWriter::flush()
 {
-    if(itsCurrentPos && itsCurrentPos!=::write(itsFd, itsBuffer, itsCurrentPos))
+    if(itsPipe)
+        return splice();
+
+    if(!writeBuffer(itsCurrentPos))
         return false;
 
     itsCurrentPos=0;
     return true;
 }
 
+//
+// Write out the buffer, and wait for the data to reach the disk.
+bool CBufferedWriter::sync()
+{
+    return flush() && (itsPipe || "-"==itsName || 0==fdatasync(itsFd));
+}
+
 bool CBufferedWriter::seekToStart()
 {
-    return "-"!=itsName && flush() && 0==lseek(itsFd, 0, SEEK_SET);
+    if("-"!=itsName && flush() && 0==lseek64(itsFd, 0, SEEK_SET))
+    {
+        itsFilePos=0;
+        return true;
+    }
+    return false;
+}
+
+bool CBufferedWriter::writeBuffer(unsigned int size)
+{
+    if(size && size!=::write(itsFd, itsBuffer, size))
+        return false;
+
+    itsFilePos+=size;
+    if(itsFilePos>itsFileEnd)
+        itsFileEnd=itsFilePos;
+    return true;
+}
+
+//
+// Chunks are at least as large as the pipe, so splicing one chunk always drains the chunk before.
+bool CBufferedWriter::initPipe()
+{
+    struct stat info;
+
+    if(0!=fstat(itsFd, &info) || !S_ISFIFO(info.st_mode))
+        return false;
+
+    fcntl(itsFd, F_SETPIPE_SZ, constPipeSize);
+
+    int pipeSize=fcntl(itsFd, F_GETPIPE_SZ);
+
+    if(pipeSize<=0)
+        return false;
+
+    itsPipe=itsGift=true;
+    itsPipeSlots=pipeSize/pageSize;
+    itsBufferSize=(((pipeSize>constMinChunkSize ? pipeSize : constMinChunkSize)+pageSize-1)/pageSize)*pageSize;
+    if(splice())
+        return true;
+
+    itsPipe=itsGift=false;
+    itsBufferSize=constBufferSize;
+    return false;
+}
+
+//
+// Gift the current chunk to the pipe, and then move on to a chunk the pipe no longer references.
+bool CBufferedWriter::splice()
+{
+    if(itsCurrentChunk>=0 && itsCurrentPos)
+    {
+        struct iovec iov;
+        uint64_t     slots=(itsCurrentPos+pageSize-1)/pageSize;
+
+        iov.iov_base=itsBuffer;
+        iov.iov_len=itsCurrentPos;
+
+        while(iov.iov_len)
+        {
+            ssize_t written=itsGift ? vmsplice(itsFd, &iov, 1, SPLICE_F_GIFT) : ::write(itsFd, iov.iov_base, iov.iov_len);
+
+            if(written<0 && EINTR==errno)
+                continue;
+            if(written<0 && itsGift && EINVAL==errno)
+            {
+                // vmsplice not supported, so fall back to copying - chunks may then be re-used at once
+                itsGift=false;
+                itsPipeSlots=0;
+                continue;
+            }
+            if(written<=0)
+                return false;
+            iov.iov_base=((unsigned char *)iov.iov_base)+written;
+            iov.iov_len-=written;
+        }
+
+        itsSlotsSpliced+=slots;
+        itsChunks[itsCurrentChunk].releaseAt=itsSlotsSpliced+itsPipeSlots;
+    }
+
+    itsCurrentPos=0;
+    itsCurrentChunk=-1;
+    for(int i=0; i<itsChunks.count() && -1==itsCurrentChunk; ++i)
+        if(itsChunks[i].releaseAt<=itsSlotsSpliced)
+            itsCurrentChunk=i;
+
+    if(-1==itsCurrentChunk)
+    {
+        Chunk chunk;
+
+        chunk.data=(unsigned char *)mmap(0L, itsBufferSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(MAP_FAILED==chunk.data)
+            return false;
+        chunk.releaseAt=0;
+        itsChunks.append(chunk);
+        itsCurrentChunk=itsChunks.count()-1;
+    }
+
+    itsBuffer=itsChunks[itsCurrentChunk].data;
+    return true;
+}
+
+//
+// Wait for the reader to consume everything that was gifted to the pipe - or for it to go away.
+void CBufferedWriter::drain()
+{
+    for(;;)
+    {
+        int           queued=0;
+        struct pollfd pfd;
+
+        pfd.fd=itsFd;
+        pfd.events=POLLOUT;
+        pfd.revents=0;
+
+        if(0!=ioctl(itsFd, FIONREAD, &queued) || queued<=0 || (poll(&pfd, 1, 0)>0 && pfd.revents&(POLLERR|POLLHUP)))
+            return;
+        usleep(constDrainInterval);
+    }
 }
@@ -2,12 +2,19 @@
 #define _BUFFERED_FILE_
 
 #include <QtCore/QString>
+#include <QtCore/QList>
+#include <stdint.h>
 
 class CBufferedWriter
 {
     public:
     
-    CBufferedWriter(const QString &name);
+    //
+    // If 'expectedSize' is given, and the output is a regular file, the file is preallocated and then
+    // truncated to the amount actually written when closed.
+    //
+    // If 'resumeAt' is not negative, the existing file is truncated to that size and appended to.
+    CBufferedWriter(const QString &name, int64_t expectedSize=0, int64_t resumeAt=-1);
     ~CBufferedWriter();
 
     operator bool()    { return -1!=itsFd; }
@@ -15,15 +22,51 @@ class CBufferedWriter
     const QString & name() const { return itsName; }
     bool write(unsigned char data);
     bool write(unsigned char *data, unsigned int size);
+    //
+    // Returns space for 'size' bytes, which are written by commit(). This allows data to be
+    // generated directly into the output buffer.
+    unsigned char * reserve(unsigned int size);
+    bool commit(unsigned int size);
     bool flush();
+    bool sync();
     bool seekToStart();
+    bool resumed() const     { return itsResumed; }
+    int64_t position() const { return itsFilePos+itsCurrentPos; }
 
     private:
+
+    bool initPipe();
+    bool splice();
+    void drain();
+    bool writeBuffer(unsigned int size);
+
+    private:
+
+    //
+    // When writing to a pipe, data is vmsplice'd from a pool of mmap'd chunks. As the pages are
+    // gifted to the kernel, a chunk may not be re-used until the pipe has been drained of it, and is
+    // never returned to the heap.
+    struct Chunk
+    {
+        unsigned char *data;
+        uint64_t      releaseAt;
+    };
     
     int           itsFd;
     QString       itsName;
-    unsigned int  itsCurrentPos;
+    int64_t       itsFilePos,
+                  itsFileEnd;
+    bool          itsPreallocated,
+                  itsResumed;
+    unsigned int  itsCurrentPos,
+                  itsBufferSize;
     unsigned char *itsBuffer;
+    bool          itsPipe,
+                  itsGift;
+    unsigned int  itsPipeSlots;
+    uint64_t      itsSlotsSpliced;
+    QList<Chunk>  itsChunks;
+    int           itsCurrentChunk;
 };
 
 #endif
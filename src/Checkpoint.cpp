@@ -0,0 +1,101 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Checkpoint.h"
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <stdio.h>
+#include <unistd.h>
+
+static const char *constMagic="catdv-checkpoint 1";
+
+bool CCheckpoint::load(const QString &file)
+{
+    QFile f(file);
+
+    itsValues.clear();
+    if(!f.open(QIODevice::ReadOnly))
+        return false;
+
+    QTextStream str(&f);
+
+    if(str.readLine()!=constMagic || str.readLine()!=itsSignature)
+        return false;
+
+    while(!str.atEnd())
+    {
+        QString line(str.readLine());
+        int     space=line.indexOf(' ');
+
+        if(space>0)
+            add(line.left(space), line.mid(space+1));
+        else if(!line.isEmpty())
+            add(line, QString());
+    }
+
+    return true;
+}
+
+bool CCheckpoint::save(const QString &file) const
+{
+    QString tmp(file+".tmp");
+    QFile   f(tmp);
+
+    if(!f.open(QIODevice::WriteOnly))
+        return false;
+
+    {
+        QTextStream                                 str(&f);
+        QHash<QString, QStringList>::ConstIterator it(itsValues.begin()),
+                                                   end(itsValues.end());
+
+        str << constMagic << endl
+            << itsSignature << endl;
+
+        for(; it!=end; ++it)
+        {
+            QStringList::ConstIterator v((*it).begin()),
+                                       vEnd((*it).end());
+
+            for(; v!=vEnd; ++v)
+                str << it.key() << ' ' << QString(*v).replace('\n', ' ') << endl;
+        }
+    }
+
+    f.flush();
+    if(0!=fsync(f.handle()))
+    {
+        f.remove();
+        return false;
+    }
+    f.close();
+
+    return 0==rename(QFile::encodeName(tmp).constData(), QFile::encodeName(file).constData());
+}
+
+QString CCheckpoint::value(const QString &name) const
+{
+    return itsValues.contains(name) && !itsValues[name].isEmpty() ? itsValues[name].first() : QString();
+}
+
+QStringList CCheckpoint::values(const QString &name) const
+{
+    return itsValues.contains(name) ? itsValues[name] : QStringList();
+}
@@ -0,0 +1,61 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QHash>
+#include <stdint.h>
+
+//
+// The state of a long export, saved every so often by --checkpoint so that --resume can carry on
+// from there rather than from the start. Values are stored by name, and a name may have several
+// values. The signature describes the export - a checkpoint written for a different project, or
+// with different settings, is not loaded.
+class CCheckpoint
+{
+    public:
+
+    CCheckpoint(const QString &signature) : itsSignature(signature) { }
+
+    //
+    // Fails if there is no checkpoint, or it has a different signature.
+    bool        load(const QString &file);
+    //
+    // The checkpoint is written to a temporary file, which then replaces the previous one - so
+    // there is always one complete checkpoint on disk.
+    bool        save(const QString &file) const;
+    void        clear()                                             { itsValues.clear(); }
+    void        set(const QString &name, const QString &value)      { itsValues[name]=QStringList() << value; }
+    void        set(const QString &name, int64_t value)             { set(name, QString::number((long long)value)); }
+    void        add(const QString &name, const QString &value)      { itsValues[name].append(value); }
+    QString     value(const QString &name) const;
+    int64_t     number(const QString &name) const                   { return value(name).toLongLong(); }
+    QStringList values(const QString &name) const;
+
+    private:
+
+    QString                     itsSignature;
+    QHash<QString, QStringList> itsValues;
+};
+
+#endif
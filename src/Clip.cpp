@@ -24,6 +24,17 @@
 #include "Wav.h"
 #include "YUV420Extractor.h"
 #include "BufferedWriter.h"
+#include "SceneDetector.h"
+#include "DupeDetector.h"
+#include "Convert.h"
+#include "ShmSink.h"
+#include "PluginSink.h"
+#include "SinkThread.h"
+#include "PositionalWriter.h"
+#include "FrameCache.h"
+#include "Segments.h"
+#include "Checkpoint.h"
+#include "Progress.h"
 #include <iostream>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
@@ -35,10 +46,17 @@
 #include <QtXml/QDomNode>
 #include <QtXml/QDomNodeList>
 #include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtCore/QThreadPool>
+#include <QtCore/QRunnable>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVector>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <endian.h>
 #include "config.h"
 
 static Frame frame;
@@ -49,7 +67,19 @@ const double CClip::constPalFps=25.0;
 const double CClip::constNtscFps=29.97;
 char *       CClipList::subtitleFormat="%d/%m/%G|%H:%M:%S";
 bool         CClipList::displayProgress=false;
+int          CClipList::progressFd=-1;
 int          CClipList::deinterlace=0;
+int          CClipList::quality=3;
+int          CClipList::resampler=0;
+int          CClipList::audioRate=0;
+int          CClipList::threads=1;
+int          CClipList::cacheSize=0;
+QString      CClipList::cacheDir;
+bool         CClipList::incremental=false;
+QString      CClipList::checkpointFile;
+bool         CClipList::resume=false;
+int          CClipList::followTimeout=0;
+bool         CClipList::skipDupes=false;
 
 static double toSeconds(const QString &s)
 {
@@ -72,6 +102,14 @@ static QString toPath(const QString &d, const QString &f)
         : f;
 }
 
+//
+// Exit after an export has failed - first saying so on --progress-fd, if used.
+static void exitFailed()
+{
+    CProgress::failed(CClipList::progressFd);
+    exit(-1);
+}
+
 static FILE * openFile(const QString &f)
 {
     if("-"==f)
@@ -82,7 +120,7 @@ static FILE * openFile(const QString &f)
     if(!file)
     {
         std::cerr << "ERROR: Failed to create " << QFile::encodeName(f).constData() << std::endl;
-        exit(-1);
+        exitFailed();
     }
 
     return file;
@@ -93,7 +131,90 @@ static void checkFile(CBufferedWriter *f)
     if(f && !*f)
     {
         std::cerr << "ERROR: Failed to create " << QFile::encodeName(f->name()).constData() << std::endl;
-        exit(-1);
+        exitFailed();
+    }
+}
+
+static void startSinks(const QList<CSinkThread *> &sinks)
+{
+    QList<CSinkThread *>::ConstIterator it(sinks.begin()),
+                                        end(sinks.end());
+
+    for(; it!=end; ++it)
+        (*it)->start();
+}
+
+static bool outputToSinks(const QList<CSinkThread *> &sinks, const QByteArray &frame, const CFrameCache::Key &key)
+{
+    QList<CSinkThread *>::ConstIterator it(sinks.begin()),
+                                        end(sinks.end());
+
+    for(; it!=end; ++it)
+    {
+        (*it)->add(frame, key);
+        if((*it)->failed())
+            return false;
+    }
+    return true;
+}
+
+//
+// Wait for the sinks to output everything queued so far.
+static bool drainSinks(const QList<CSinkThread *> &sinks)
+{
+    QList<CSinkThread *>::ConstIterator it(sinks.begin()),
+                                        end(sinks.end());
+
+    for(; it!=end; ++it)
+    {
+        (*it)->drain();
+        if((*it)->failed())
+            return false;
+    }
+    return true;
+}
+
+//
+// Wait for the sinks to finish, and then delete the threads - the sinks themselves are not deleted.
+// The progress reporter reads the sinks, so is finished before they are deleted.
+static void finishSinks(QList<CSinkThread *> &sinks, CProgress *progress)
+{
+    bool                           failed=false;
+    QList<CSinkThread *>::Iterator it(sinks.begin()),
+                                   end(sinks.end());
+
+    for(; it!=end; ++it)
+    {
+        (*it)->finish();
+        if((*it)->failed())
+        {
+            std::cerr << (CSinkThread::InitialiseFailed==(*it)->failure() ? "Failed to initialise " : "Failed to write ")
+                      << (*it)->name().toLocal8Bit().constData() << std::endl;
+            failed=true;
+        }
+    }
+
+    if(progress)
+        progress->finish(!failed);
+    qDeleteAll(sinks);
+    sinks.clear();
+
+    if(failed)
+        exitFailed();
+}
+
+static int dvQuality(int level)
+{
+    switch(level)
+    {
+        case 0:
+            return DV_QUALITY_FASTEST;
+        case 1:
+            return DV_QUALITY_COLOR|DV_QUALITY_DC;
+        case 2:
+            return DV_QUALITY_COLOR|DV_QUALITY_AC_1;
+        default:
+            return DV_QUALITY_BEST;
     }
 }
 
@@ -132,17 +253,15 @@ QString timeStr(int64_t frames, double frameRate)
 }
 
 CClip::CClip(const QString &fn, double f, double t, const QString &ch)
-     : itsFd(-1),
-       itsFileName(fn),
+     : itsFileName(fn),
        itsChapter(ch),
        itsFrom(-1),
        itsTo(-1),
-       itsCurrent(-1),
-       itsLength(-1)
+       itsLength(-1),
+       itsToEnd(false)
 {
     int64_t fSize=init();
 
-    reset();
     if(fSize)
     {
         // Now check range...
@@ -152,7 +271,7 @@ CClip::CClip(const QString &fn, double f, double t, const QString &ch)
             itsTo=(int64_t)((t*frameRate())+0.5);
 
             int64_t fromByte=itsFrom*frameSize(),
-                    toByte=itsTo*frameSize();
+                    toByte=(itsTo+1)*frameSize();
 
             if(fromByte<=fSize && toByte<=fSize)
                 itsLength=(itsTo-itsFrom)+1; // from..to is inclusive!
@@ -160,30 +279,30 @@ CClip::CClip(const QString &fn, double f, double t, const QString &ch)
         else
         {
             itsFrom=0;
-            itsTo=itsLength=fSize/frameSize();
+            itsLength=fSize/frameSize();
+            itsTo=itsLength-1; // from..to is inclusive!
+            itsToEnd=true;
         }
     }
 }
 
 CClip::CClip(const QString &fn, int64_t f, int64_t t, const QString &ch)
-     : itsFd(-1),
-       itsFileName(fn),
+     : itsFileName(fn),
        itsChapter(ch),
        itsFrom(f),
        itsTo(t),
-       itsCurrent(-1),
-       itsLength(-1)
+       itsLength(-1),
+       itsToEnd(false)
 {
     int64_t fSize=init();
 
-    reset();
     if(fSize)
     {
         // Now check range...
         if(itsFrom>=0 && itsTo>=0)
         {
             int64_t fromByte=itsFrom*frameSize(),
-                    toByte=itsTo*frameSize();
+                    toByte=(itsTo+1)*frameSize();
 
             if(fromByte<=fSize && toByte<=fSize)
                 itsLength=(itsTo-itsFrom)+1; // from..to is inclusive!
@@ -191,11 +310,34 @@ CClip::CClip(const QString &fn, int64_t f, int64_t t, const QString &ch)
         else
         {
             itsFrom=0;
-            itsTo=itsLength=fSize/frameSize();
+            itsLength=fSize/frameSize();
+            itsTo=itsLength-1; // from..to is inclusive!
+            itsToEnd=true;
         }
     }
 }
 
+//
+// A stream starts as one frame long, and grows as CReadPlan reads it.
+CClip::CClip(const QSharedPointer<CStream> &stream)
+     : itsFileName(stream->name()),
+       itsFrom(-1),
+       itsTo(-1),
+       itsLength(-1),
+       itsToEnd(true),
+       itsStream(stream)
+{
+    if(stream->isOk())
+    {
+        frame.data=(unsigned char *)stream->firstFrame();
+        frame.ExtractHeader();
+        itsType=frame.IsPAL() ? Pal : Ntsc;
+        itsFormat=frame.IsWide() ? Widescreen : Normal;
+        itsFrom=itsTo=0;
+        itsLength=1;
+    }
+}
+
 bool CClip::similar(const CClip &other) const
 {
     return itsType==other.itsType && /*itsProgressive==other.itsProgressive &&*/ itsFormat==other.itsFormat;
@@ -206,72 +348,61 @@ QString CClip::duration() const
     return QTime().addSecs((int)((itsLength/frameRate())+0.5)).toString();
 }
 
-void CClip::reset()
+//
+// Random access read of a single frame - 'f' is relative to the start of the clip.
+bool CClip::readFrame(int64_t f, unsigned char *buffer, int count) const
 {
-    if(-1!=itsFd)
-        close(itsFd);
-    itsFd=-1;
-    itsCurrent=-1;
-}
+    bool ok=false;
 
-unsigned char * CClip::nextFrame()
-{
-    if(!itsFileName.isEmpty())
+    if(itsContainer && f>=0 && count>0 && f+count<=itsLength)
     {
-        if(itsFd<0)
-        {
-            itsFd=open64(QFile::encodeName(itsFileName).constData(), O_RDONLY);
-            if(itsFd<0 || (0!=itsFrom && -1==lseek64(itsFd, frameSize()*itsFrom, SEEK_SET)))
-            {
-                close(itsFd);
-                itsFd=-1;
-            }
-            itsCurrent=itsFrom;
-        }
+        for(int i=0; i<count; ++i)
+            memcpy(buffer+(i*frameSize()), itsContainer->frame(itsFrom+f+i), frameSize());
+        ok=true;
+    }
+    else if(!itsFileName.isEmpty() && f>=0 && count>0 && f+count<=itsLength)
+    {
+        int fd=open64(QFile::encodeName(itsFileName).constData(), O_RDONLY);
 
-        if(itsFd>=0 && itsCurrent++<=itsTo)
+        if(fd>=0)
         {
-            // Speed up disk access by reading blocks of 'constMaxNumFrames' frames...
-            static const int     constMaxNumFrames=100;
-            static unsigned char frameBuffer[constMaxNumFrames*constPalFrameSize];
-            static int64_t       bufferNumFrames=0;
-            static int64_t       bufferPos=bufferNumFrames;
-
-            if(++bufferPos<bufferNumFrames)
-                return &frameBuffer[frameSize()*bufferPos];
-            else
-            {
-                bufferPos=0;
-                bufferNumFrames=(itsTo-itsCurrent)+2; // +2 as we increment current above!
-
-                if(bufferNumFrames>constMaxNumFrames)
-                    bufferNumFrames=constMaxNumFrames;
-
-                int64_t toRead=frameSize()*bufferNumFrames;
-
-                if(bufferNumFrames>0 && toRead==::read(itsFd, frameBuffer, toRead))
-                    return &frameBuffer[0];
-            }
+            ok=count*frameSize()==pread64(fd, buffer, count*frameSize(), (itsFrom+f)*frameSize());
+            close(fd);
         }
-
-        reset();
     }
 
-    return 0L;
+    return ok;
 }
 
+//
+// Returns the size of the DV - for an AVI, or MOV, this is the size that it would be as raw DV.
 int64_t CClip::init()
 {
     int64_t size=0;
-    if(!itsFileName.isEmpty())
+
+    if(CContainer::isContainer(itsFileName))
+    {
+        itsContainer=CContainer::open(itsFileName);
+        if(itsContainer->isOk())
+        {
+            frame.data=(unsigned char *)itsContainer->frame(0);
+            frame.ExtractHeader();
+            itsType=frame.IsPAL() ? Pal : Ntsc;
+            itsFormat=frame.IsWide() ? Widescreen : Normal;
+            size=itsContainer->frames()*frameSize();
+        }
+    }
+    else if(!itsFileName.isEmpty())
     {
         int fd=open64(QFile::encodeName(itsFileName).constData(), O_RDONLY|O_LARGEFILE);
 
         if(-1!=fd)
         {
             unsigned char frameBuffer[constPalFrameSize];
+            ssize_t       got=::read(fd, frameBuffer, constPalFrameSize);
 
-            if(constPalFrameSize==::read(fd, frameBuffer, constPalFrameSize))
+            // A file that is still being captured may only hold one NTSC frame, which is smaller than a PAL one
+            if(got>=constNtscFrameSize)
             {
                 frame.data=frameBuffer;
                 frame.ExtractHeader();
@@ -279,7 +410,7 @@ int64_t CClip::init()
                 itsFormat=frame.IsWide() ? Widescreen : Normal;
 
                 struct stat64 statbuf;
-                if(0==fstat64(fd, &statbuf))
+                if(got>=frameSize() && 0==fstat64(fd, &statbuf))
                     size=statbuf.st_size;
             }
             close(fd);
@@ -309,7 +440,8 @@ bool CClipList::save(const QString &f) const
 bool CClipList::load(const QString &f)
 {
     clearList();
-    return (Misc::checkExt(f, "dv") && loadDv(f)) ||
+    return (CStream::isStream(f) && loadStream(f)) ||
+           ((Misc::checkExt(f, "dv") || CContainer::isContainer(f)) && loadDv(f)) ||
            (Misc::checkExt(f, "kdenlive") && loadKdenlive(f)) ||
            ((Misc::checkExt(f, "smil") || Misc::checkExt(f, "kino")) && loadKino(f));
 }
@@ -337,6 +469,18 @@ void CClipList::clearList()
     reset();
 }
 
+bool CClipList::streaming() const
+{
+    ConstIterator it(begin()),
+                  e(end());
+
+    for(; it!=e; ++it)
+        if((*it).stream())
+            return true;
+
+    return false;
+}
+
 bool CClipList::check() const
 {
     QList<CClip>::ConstIterator first(begin()),
@@ -481,22 +625,591 @@ static QString toString(const QList<Chapter> &chapters)
     return ch;
 }
 
+//
+// As every Y4M frame is the same size, and the number of audio samples in each frame is known from its
+// AAUX source pack, the output offset of every frame is known before decoding. Frames may then be
+// decoded and written in any order.
+struct CExportPlan
+{
+    struct Range
+    {
+        const CClip *clip;
+        int64_t     start;
+        bool        reuseYuv, // Copied from the previous output by --incremental
+                    reuseWav;
+    };
+
+    QList<Range>     ranges;
+    bool             pal;
+    int64_t          frames,
+                     yuvHeaderSize,
+                     yuvFrameSize;
+    QVector<int64_t> audioOffsets; // Offset of each frame's audio in the WAV, plus the end
+};
+
+//
+// libdv reads the AAUX source pack from the 4th audio DIF block of the 1st DIF sequence.
+static const int constAauxSourceOffset=80*(6+(16*3))+3;
+static const int constParallelBlock=25;
+static const int constMaxAudioSize=1944*2*2;
+static const int constHeaderBatch=250; // Frames whose AAUX packs are mapped at once when planning
+
+static int aauxSamples(const unsigned char *pack, bool pal, int &rate)
+{
+    static const int constRates[3]={ 48000, 44100, 32000 };
+    static const int constMinSamples[2][3]={ { 1580, 1452, 1053 }, { 1896, 1742, 1264 } };
+
+    int smp=(pack[4]>>3)&0x07,
+        chn=(pack[2]>>5)&0x03;
+
+    // Only 16 bit stereo audio is planned - the WAV header, and the size of each frame's audio, assume
+    // 2 channels. Anything else is left to the serial writer, which uses the channels libdv decodes.
+    if(0x50!=pack[0] || smp>2 || 0!=(pack[4]&0x07) || 0!=chn)
+        return -1;
+
+    rate=constRates[smp];
+    return (pack[1]&0x3F)+constMinSamples[pal ? 1 : 0][smp];
+}
+
+//
+// Append the WAV offset of the end of each of 'count' frames, starting at frame 'first' of the DV
+// file, to 'offsets' - and return the total size of their audio. Returns -1 if this is not known, or
+// the sample rate is not 'rate' (which is set, if 0). The packs are read from a mapping of a batch of
+// frames at a time, rather than with a read per frame.
+static int64_t audioBytes(int fd, const CClip &clip, int64_t first, int64_t count, int &rate, QVector<int64_t> *offsets)
+{
+    static const int64_t constPageSize=sysconf(_SC_PAGESIZE);
+
+    int64_t total=0;
+
+    for(int64_t batch=first; batch<first+count; batch+=constHeaderBatch)
+    {
+        int64_t       end=batch+constHeaderBatch<first+count ? batch+constHeaderBatch : first+count,
+                      from=((clip.offset(batch)+constAauxSourceOffset)/constPageSize)*constPageSize,
+                      to=clip.offset(end-1)+constAauxSourceOffset+5;
+        void          *mem=to>from ? mmap64(0L, to-from, PROT_READ, MAP_SHARED, fd, from) : MAP_FAILED;
+        unsigned char *map=MAP_FAILED!=mem ? (unsigned char *)mem : 0L;
+
+        if(!map)
+            return -1;
+
+        for(int64_t f=batch; f<end; ++f)
+        {
+            int64_t pos=clip.offset(f)+constAauxSourceOffset;
+            int     frameRate=0,
+                    samples=pos>=from && pos+5<=to ? aauxSamples(map+(pos-from), CClip::Pal==clip.type(), frameRate) : -1;
+
+            if(samples<0 || (rate && frameRate!=rate))
+            {
+                munmap(mem, to-from);
+                return -1;
+            }
+            rate=frameRate;
+            total+=samples*4;
+            if(offsets)
+                offsets->append(offsets->last()+(samples*4));
+        }
+
+        munmap(mem, to-from);
+    }
+
+    return total;
+}
+
+static void removeManifests(const QString &wavFile, const QString &yuvFile)
+{
+    if(!wavFile.isEmpty() && "-"!=wavFile)
+        QFile::remove(CSegmentManifest::fileName(wavFile));
+    if(!yuvFile.isEmpty() && "-"!=yuvFile)
+        QFile::remove(CSegmentManifest::fileName(yuvFile));
+}
+
+//
+// Open the previous output, if its manifest was written with the same settings. The file is then
+// unlinked, so that the new output is a new file, and the previous one lasts until 'fd' is closed.
+// If it cannot be unlinked, creating the new output would truncate it whilst it is being copied
+// from - so nothing is re-used, and everything is decoded.
+static int openPrevious(const QString &file, CSegmentManifest &manifest)
+{
+    if(file.isEmpty() || !manifest.load(file))
+        return -1;
+
+    int fd=open64(QFile::encodeName(file).constData(), O_RDONLY|O_LARGEFILE);
+
+    if(-1!=fd && 0!=unlink(QFile::encodeName(file).constData()))
+    {
+        std::cerr << "WARNING: Failed to replace " << QFile::encodeName(file).constData()
+                  << ", so all of it will be re-exported" << std::endl;
+        close(fd);
+        fd=-1;
+    }
+    return fd;
+}
+
+class CParallelExporter : public QRunnable
+{
+    public:
+
+    CParallelExporter(const CExportPlan &plan, CPositionalWriter *yuv, CPositionalWriter *wav,
+                      QAtomicInt &nextBlock, QAtomicInt &done, QAtomicInt &failed, FILE *errorLog)
+        : itsPlan(plan), itsYuv(yuv), itsWav(wav), itsNextBlock(nextBlock), itsDone(done), itsFailed(failed)
+    {
+        itsFrame.decoder->audio->error_log=errorLog;
+        itsFrame.decoder->video->error_log=errorLog;
+    }
+
+    void run()
+    {
+        unsigned char   *raw=new unsigned char[constParallelBlock*CClip::constPalFrameSize],
+                        *yuv=itsYuv ? new unsigned char[itsPlan.yuvFrameSize] : 0L,
+                        *pcm=itsWav ? new unsigned char[constMaxAudioSize] : 0L;
+        YUV420Extractor *extractor=itsYuv ? YUV420Extractor::GetExtractor(0L, itsPlan.pal, CClipList::deinterlace) : 0L;
+        bool            initialised=false;
+
+        for(;;)
+        {
+            int64_t first=((int64_t)itsNextBlock.fetchAndAddOrdered(1))*constParallelBlock,
+                    last=first+constParallelBlock;
+
+            if(first>=itsPlan.frames || itsFailed.load())
+                break;
+            if(last>itsPlan.frames)
+                last=itsPlan.frames;
+
+            for(int64_t g=first; g<last;)
+            {
+                int r=itsPlan.ranges.count()-1;
+
+                while(r>0 && itsPlan.ranges[r].start>g)
+                    r--;
+
+                const CExportPlan::Range &range(itsPlan.ranges[r]);
+                int64_t                  end=range.start+range.clip->length();
+                int                      count=(end<last ? end : last)-g,
+                                         frameSize=range.clip->frameSize();
+                bool                     yuvFrames=itsYuv && !range.reuseYuv,
+                                         wavFrames=itsWav && !range.reuseWav;
+
+                if(!yuvFrames && !wavFrames)
+                {
+                    g+=count;
+                    itsDone.fetchAndAddRelaxed(count);
+                    continue;
+                }
+
+                if(!range.clip->readFrame(g-range.start, raw, count))
+                {
+                    itsFailed.store(1);
+                    break;
+                }
+
+                for(int i=0; i<count; ++i, ++g)
+                {
+                    itsFrame.data=raw+(i*frameSize);
+                    itsFrame.ExtractHeader();
+
+                    if(extractor && yuvFrames)
+                    {
+                        int     planeSize=itsFrame.GetWidth()*itsFrame.GetHeight();
+                        uint8_t *planes[3]={ yuv+6, yuv+6+planeSize, yuv+6+planeSize+(planeSize/4) };
+
+                        if(!initialised && !(initialised=extractor->Initialise(itsFrame)))
+                        {
+                            itsFailed.store(1);
+                            break;
+                        }
+                        memcpy(yuv, "FRAME\n", 6);
+                        extractor->Extract(itsFrame, planes);
+                        if(!itsYuv->write(itsPlan.yuvHeaderSize+(g*itsPlan.yuvFrameSize), yuv, itsPlan.yuvFrameSize))
+                            itsFailed.store(1);
+                    }
+
+                    if(wavFrames)
+                    {
+                        int size=itsPlan.audioOffsets[g+1]-itsPlan.audioOffsets[g],
+                            got=itsFrame.ExtractAudio(pcm);
+
+                        // A frame that fails to decode is silent, as it is when written serially - but
+                        // audio that does not match the plan would garble the WAV
+                        if(got<=0)
+                            memset(pcm, 0, size);
+                        else if(got!=size)
+                        {
+                            itsFailed.store(1);
+                            break;
+                        }
+#if __BYTE_ORDER == __BIG_ENDIAN
+                        for(int b=0; b<size; b+=2)
+                        {
+                            unsigned char t=pcm[b];
+                            pcm[b]=pcm[b+1];
+                            pcm[b+1]=t;
+                        }
+#endif
+                        if(!itsWav->write(itsPlan.audioOffsets[g], pcm, size))
+                            itsFailed.store(1);
+                    }
+                    itsDone.fetchAndAddRelaxed(1);
+                }
+
+                if(itsFailed.load())
+                    break;
+            }
+        }
+
+        if(extractor && initialised)
+            extractor->Flush();
+        delete extractor;
+        delete [] raw;
+        delete [] yuv;
+        delete [] pcm;
+    }
+
+    private:
+
+    Frame             itsFrame;
+    const CExportPlan &itsPlan;
+    CPositionalWriter *itsYuv,
+                      *itsWav;
+    QAtomicInt        &itsNextBlock,
+                      &itsDone,
+                      &itsFailed;
+};
+
+//
+// Decode with --threads workers, writing YUV and WAV frames straight to their final offsets. Returns
+// false, without touching the outputs, if this is not possible - i.e. the outputs are not regular
+// files, or the audio needs resampling.
+bool CClipList::outputParallel(const QString &wavFile, const QString &yuvFile)
+{
+    if((!yuvFile.isEmpty() && !CPositionalWriter::isRegular(yuvFile)) ||
+       (!wavFile.isEmpty() && !CPositionalWriter::isRegular(wavFile)))
+        return false;
+
+    CExportPlan   plan;
+    ConstIterator it(begin()),
+                  endIt(end());
+    int           rate=0;
+
+    plan.frames=0;
+    plan.pal=CClip::Pal==(*begin()).type();
+    plan.yuvHeaderSize=plan.yuvFrameSize=0;
+    if(!wavFile.isEmpty())
+        plan.audioOffsets.append(Wav::HeaderSize);
+
+    for(; it!=endIt; ++it)
+    {
+        CExportPlan::Range range;
+
+        range.clip=&(*it);
+        range.start=plan.frames;
+        range.reuseYuv=range.reuseWav=false;
+        plan.ranges.append(range);
+        plan.frames+=(*it).length();
+
+        if(!wavFile.isEmpty())
+        {
+            int fd=open64(QFile::encodeName((*it).fileName()).constData(), O_RDONLY|O_LARGEFILE);
+
+            if(-1==fd)
+                return false;
+
+            int64_t bytes=audioBytes(fd, *it, (*it).from(), (*it).length(), rate, &plan.audioOffsets);
+
+            close(fd);
+            if(bytes<0 || (audioRate && rate!=audioRate))
+                return false;
+        }
+    }
+
+    unsigned char *first=new unsigned char[CClip::constPalFrameSize];
+
+    if(!(*begin()).readFrame(0, first))
+    {
+        delete [] first;
+        return false;
+    }
+
+    Frame::preferred_quality=dvQuality(quality);
+    frame.data=first;
+    frame.ExtractHeader();
+
+    YUV420Extractor *extractor=!yuvFile.isEmpty() ? YUV420Extractor::GetExtractor(0L, plan.pal, deinterlace) : 0L;
+
+    if(extractor && extractor->Initialise(frame))
+    {
+        plan.yuvHeaderSize=strlen(extractor->Header());
+        plan.yuvFrameSize=6+(frame.GetWidth()*frame.GetHeight()*3/2);
+    }
+
+    // The manifests record where each clip's frames are in the outputs, along with anything that
+    // changes the bytes output for a frame. Any manifest is removed before its output is replaced.
+    QString          yuvSettings(extractor ? QString().sprintf("yuv %d %d ", quality, deinterlace)+
+                                             QString(extractor->Header()).trimmed() : QString()),
+                     wavSettings(QString().sprintf("wav %d", rate));
+    CSegmentManifest yuvPrevious(yuvSettings),
+                     yuvSegments(yuvSettings),
+                     wavPrevious(wavSettings),
+                     wavSegments(wavSettings);
+    int              yuvPrevFd=incremental && extractor ? openPrevious(yuvFile, yuvPrevious) : -1,
+                     wavPrevFd=incremental ? openPrevious(wavFile, wavPrevious) : -1;
+
+    removeManifests(wavFile, yuvFile);
+
+    CPositionalWriter *yuv=extractor ? new CPositionalWriter(yuvFile, plan.yuvHeaderSize+(plan.frames*plan.yuvFrameSize)) : 0L,
+                      *wav=!wavFile.isEmpty() ? new CPositionalWriter(wavFile, plan.audioOffsets.last()) : 0L;
+
+    if((yuv && !*yuv) || (wav && !*wav))
+    {
+        std::cerr << "ERROR: Failed to create " << QFile::encodeName(yuv && !*yuv ? yuvFile : wavFile).constData() << std::endl;
+        exitFailed();
+    }
+
+    // Copy the clips that are unchanged since the previous export, and note where every clip is
+    QList<CExportPlan::Range>::Iterator rIt(plan.ranges.begin()),
+                                        rEnd(plan.ranges.end());
+
+    for(; rIt!=rEnd; ++rIt)
+    {
+        const CClip               &clip(*(*rIt).clip);
+        CSegmentManifest::Segment segment;
+
+        if(!CSegmentManifest::identify(clip.fileName(), segment))
+            continue;
+
+        segment.from=clip.from();
+        segment.count=clip.length();
+
+        if(yuv)
+        {
+            const CSegmentManifest::Segment *prev=-1!=yuvPrevFd ? yuvPrevious.find(segment) : 0L;
+
+            segment.offset=plan.yuvHeaderSize+((*rIt).start*plan.yuvFrameSize);
+            segment.length=segment.count*plan.yuvFrameSize;
+            yuvSegments.add(segment);
+            (*rIt).reuseYuv=prev && yuv->copy(segment.offset, yuvPrevFd,
+                                              prev->offset+((segment.from-prev->from)*plan.yuvFrameSize), segment.length);
+        }
+
+        if(wav)
+        {
+            const CSegmentManifest::Segment *prev=-1!=wavPrevFd ? wavPrevious.find(segment) : 0L;
+
+            segment.offset=plan.audioOffsets[(*rIt).start];
+            segment.length=plan.audioOffsets[(*rIt).start+segment.count]-segment.offset;
+            wavSegments.add(segment);
+
+            if(prev)
+            {
+                int     fd=open64(QFile::encodeName(clip.fileName()).constData(), O_RDONLY|O_LARGEFILE),
+                        prevRate=rate;
+                int64_t skip=-1==fd ? -1 : audioBytes(fd, clip, prev->from, segment.from-prev->from, prevRate, 0L);
+
+                if(-1!=fd)
+                    close(fd);
+                (*rIt).reuseWav=skip>=0 && wav->copy(segment.offset, wavPrevFd, prev->offset+skip, segment.length);
+            }
+        }
+    }
+
+    if(-1!=yuvPrevFd)
+        close(yuvPrevFd);
+    if(-1!=wavPrevFd)
+        close(wavPrevFd);
+
+    if(yuv)
+        yuv->write(0, extractor->Header(), plan.yuvHeaderSize);
+    if(wav)
+    {
+        unsigned char header[Wav::HeaderSize];
+
+        Wav::MakeHeader(header, 2, rate, plan.audioOffsets.last()-Wav::HeaderSize);
+        wav->write(0, header, Wav::HeaderSize);
+    }
+
+    if(extractor)
+        extractor->Flush();
+    delete extractor;
+    delete [] first;
+    frame.data=0L;
+
+    QThreadPool                 pool;
+    QAtomicInt                  nextBlock(0),
+                                done(0),
+                                failed(0);
+    FILE                        *devNull=fopen("/dev/null", "w");
+    int                         start=time(NULL);
+    QList<CParallelExporter *>  workers;
+
+    pool.setMaxThreadCount(threads);
+    for(int i=0; i<threads; ++i)
+    {
+        workers.append(new CParallelExporter(plan, yuv, wav, nextBlock, done, failed, devNull));
+        workers.last()->setAutoDelete(false);
+    }
+    CProgress                   *progress=progressFd>=0 ? new CProgress(progressFd, plan.frames) : 0L;
+
+    for(int i=0; i<threads; ++i)
+        pool.start(workers[i]);
+    if(progress)
+        progress->start();
+
+    if(displayProgress)
+        fprintf(stderr, "  0%%     0fps");
+
+    while(!pool.waitForDone(500))
+    {
+        if(progress)
+            progress->setFrames(done.load());
+        if(displayProgress && plan.frames)
+        {
+            int diff=time(NULL)-start,
+                count=done.load();
+
+            fprintf(stderr, "\b\b\b\b\b\b\b\b\b\b\b\b\b%3d%%  %4dfps", (int)((count*100)/plan.frames), diff ? count/diff : count);
+        }
+    }
+
+    if(progress)
+    {
+        progress->setFrames(done.load());
+        progress->finish(!failed.load());
+        delete progress;
+    }
+
+    if(displayProgress)
+        fprintf(stderr, "\b\b\b\b\b\b\b\b\b\b\b\b\b100%%\n");
+
+    qDeleteAll(workers);
+    delete yuv;
+    delete wav;
+    if(devNull)
+        fclose(devNull);
+
+    if(failed.load())
+    {
+        std::cerr << "ERROR: Failed to read or write frames" << std::endl;
+        exitFailed();
+    }
+
+    if(incremental)
+    {
+        if(!yuvFile.isEmpty())
+            yuvSegments.save(yuvFile);
+        if(!wavFile.isEmpty())
+            wavSegments.save(wavFile);
+    }
+    return true;
+}
+
+//
+// --checkpoint saves the state of output() this often
+static const int constCheckpointInterval=1500;
+
+//
+// Identifies an export, so that a checkpoint is only resumed by the same project with the same settings. Each clip
+// is identified by its range and its file, so that a clip that has been re-captured or trimmed is not resumed either.
+static QString checkpointSignature(const CClipList &clips, int frames, const QStringList &outputs, int adjust)
+{
+    QString                  sig(QString::asprintf("%d %d %d %d %d %d %d %s|", frames, clips.count(), CClipList::quality,
+                                                   CClipList::deinterlace, CClipList::resampler, CClipList::audioRate,
+                                                   adjust, CClipList::subtitleFormat)+outputs.join("|"));
+    CClipList::ConstIterator it(clips.begin()),
+                             end(clips.end());
+
+    for(; it!=end; ++it)
+    {
+        CSegmentManifest::Segment segment;
+
+        if(!CSegmentManifest::identify((*it).fileName(), segment))
+            segment.device=segment.inode=segment.size=segment.mtime=0;
+
+        sig+=QString::asprintf("|%lld %lld %llu %llu %lld %lld ", (long long)(*it).from(), (long long)(*it).to(),
+                               (unsigned long long)segment.device, (unsigned long long)segment.inode,
+                               (long long)segment.size, (long long)segment.mtime)+(*it).fileName();
+    }
+
+    // The signature is saved as a single line
+    return sig.replace('\n', ' ');
+}
+
+static void checkSync(CBufferedWriter *f)
+{
+    if(f && !f->sync())
+    {
+        std::cerr << "ERROR: Failed to write " << QFile::encodeName(f->name()).constData() << std::endl;
+        exitFailed();
+    }
+}
+
+//
+// These are estimates - the files are truncated to the size actually written.
+int64_t CClipList::expectedYuvSize() const
+{
+    ConstIterator firstClip(begin());
+    int64_t       planeSize=720*(CClip::Pal==(*firstClip).type() ? 576 : 480);
+
+    return 128+(itsTotalFrames*(6+(planeSize*3/2)));
+}
+
+int64_t CClipList::expectedWavSize() const
+{
+    ConstIterator firstClip(begin());
+
+    return Wav::HeaderSize+(int64_t)(((itsTotalFrames/(*firstClip).frameRate())+1)*(audioRate ? audioRate : 48000)*4);
+}
+
 void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
-                       const QString &wavFile, const QString &yuvFile, const QString &kmfFile, int adjust)
+                       const QString &wavFile, const QString &yuvFile, const QString &kmfFile,
+                       const QString &scenesFile, const QString &dupesFile, const QString &shmName,
+                       const QStringList &sinks, int adjust)
 {
+    // Only YUV and WAV may be written out of order - everything else depends upon the previous frame
+    if((threads>1 || incremental) && checkpointFile.isEmpty() && 0==followTimeout && !streaming() && subFile.isEmpty() && dvdAuthorFile.isEmpty() && kmfFile.isEmpty() && scenesFile.isEmpty() &&
+       dupesFile.isEmpty() && !skipDupes && shmName.isEmpty() && sinks.isEmpty() && outputParallel(wavFile, yuvFile))
+        return;
+
+    // These outputs are about to be replaced, so any --incremental manifest no longer describes them
+    removeManifests(wavFile, yuvFile);
+
+    CCheckpoint     checkpoint(checkpointSignature(*this, itsTotalFrames, QStringList() << subFile << dvdAuthorFile << wavFile << yuvFile
+                                                                            << kmfFile << scenesFile << dupesFile
+                                                                            << QString(skipDupes ? "skip-dupes" : ""), adjust));
+    bool            resuming=resume && !checkpointFile.isEmpty() && QFile::exists(checkpointFile);
+
+    if(resuming && !checkpoint.load(checkpointFile))
+    {
+        std::cerr << "ERROR: " << QFile::encodeName(checkpointFile).constData() << " is not a checkpoint of this export" << std::endl;
+        exitFailed();
+    }
+
+    if(resuming && ("-"==subFile || "-"==wavFile || "-"==yuvFile))
+    {
+        std::cerr << "ERROR: Output to stdout cannot be resumed" << std::endl;
+        exitFailed();
+    }
+
     int64_t         frameCount(0),
-                    lastFrame(0);
+                    lastFrame(0),
+                    skipped(0);
     struct tm       now;
     struct tm       lastTime;
-    Wav             *wavExp=0L;
-    YUV420Extractor *yuvExp=0L;
     FILE            *dvda=!dvdAuthorFile.isEmpty() ? openFile(dvdAuthorFile) : 0L,
                     *dvdc=dvda ? openFile(dvdAuthorFile+".chapters") : 0L,
                     *dvdt=dvda ? openFile(dvdAuthorFile+".title") : 0L,
-                    *kmf=!kmfFile.isEmpty() ? openFile(kmfFile) : 0L;
-    CBufferedWriter *wav=!wavFile.isEmpty() ? new CBufferedWriter(wavFile) : 0L,
-                    *yuv=!yuvFile.isEmpty() ? new CBufferedWriter(yuvFile) : 0L,
-                    *sub=!subFile.isEmpty() ? new CBufferedWriter(subFile) : 0L;
+                    *kmf=!kmfFile.isEmpty() ? openFile(kmfFile) : 0L,
+                    *scn=!scenesFile.isEmpty() ? openFile(scenesFile) : 0L,
+                    *dup=!dupesFile.isEmpty() ? openFile(dupesFile) : 0L;
+    CSceneDetector  *scenes=scn ? new CSceneDetector : 0L;
+    CDupeDetector   *dupes=dup || skipDupes ? new CDupeDetector : 0L;
+    CBufferedWriter *wav=!wavFile.isEmpty() ? new CBufferedWriter(wavFile, expectedWavSize(), resuming ? checkpoint.number("wav") : -1) : 0L,
+                    *yuv=!yuvFile.isEmpty() ? new CBufferedWriter(yuvFile, expectedYuvSize(), resuming ? checkpoint.number("yuv") : -1) : 0L,
+                    *sub=!subFile.isEmpty() ? new CBufferedWriter(subFile, 0, resuming ? checkpoint.number("sub") : -1) : 0L;
+    Wav             *wavExp=wav ? new Wav(*wav, audioRate, 1==resampler) : 0L;
+    YUV420Extractor *yuvExp=yuv ? YUV420Extractor::GetExtractor(yuv, CClip::Pal==(*begin()).type(), deinterlace) : 0L;
+    CShmSink        *shm=!shmName.isEmpty() ? new CShmSink(shmName) : 0L;
+    CPluginSinks    *plugins=!sinks.isEmpty() ? new CPluginSinks(sinks) : 0L;
+    QList<CSinkThread *> sinkThreads;
     QString         startDateTime,
                     endDateTime;
     ConstIterator   firstClip(begin());
@@ -512,10 +1225,13 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
     FILE            *stdErr=displayProgress ? stderr : 0,
                     *devNull=fopen("/dev/null", "w");
     int             start=time(NULL);
-    bool            secondsInSubtitles=sub && subtitleFormat && NULL!=strstr(subtitleFormat, "%S");
+    bool            secondsInSubtitles=sub && subtitleFormat && NULL!=strstr(subtitleFormat, "%S"),
+                    stream=streaming();
 
     frame.decoder->audio->error_log=devNull;
     frame.decoder->video->error_log=devNull;
+    Frame::preferred_quality=dvQuality(quality);
+    frame.SetPreferredQuality();
 
     if(displayProgress)
         stderr=devNull;
@@ -526,13 +1242,113 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
     checkFile(wav);
     checkFile(yuv);
 
-    if(displayProgress)
+    if(shm && !*shm)
+    {
+        std::cerr << "ERROR: Failed to create shared memory " << QFile::encodeName(shmName).constData() << std::endl;
+        exitFailed();
+    }
+
+    if(plugins && !plugins->error().isEmpty())
+    {
+        std::cerr << "ERROR: " << plugins->error().toLocal8Bit().constData() << std::endl;
+        exitFailed();
+    }
+
+    // Each sink runs on its own thread, so a slow output does not hold up the others
+    if(wavExp)
+        sinkThreads.append(new CSinkThread(wavExp, "audio file "+wavFile, devNull, wav));
+    if(yuvExp)
+        sinkThreads.append(new CSinkThread(yuvExp, "yuv file "+yuvFile, devNull, yuv));
+    if(shm)
+        sinkThreads.append(new CSinkThread(shm, "shared memory "+shmName, devNull));
+    if(plugins)
+        sinkThreads.append(new CSinkThread(plugins, "sink plugins", devNull));
+    if(cacheSize && !sinkThreads.isEmpty())
+        CFrameCache::instance=cacheDir.isEmpty() && !CFrameCache::sharedDir.isEmpty()
+                                ? new CFrameCache(((int64_t)cacheSize)*1024*1024, CFrameCache::sharedDir, true)
+                                : new CFrameCache(((int64_t)cacheSize)*1024*1024, cacheDir);
+    startSinks(sinkThreads);
+
+    if(resuming)
+    {
+        QStringList                chapterList(checkpoint.values("chapter")),
+                                   titleList(checkpoint.values("title")),
+                                   sceneList(checkpoint.values("scene")),
+                                   dupeList(checkpoint.values("dupe"));
+        QStringList::ConstIterator it;
+
+        frameCount=checkpoint.number("frameCount");
+        skipped=checkpoint.number("skipped");
+        lastFrame=checkpoint.number("lastFrame");
+        lastchapterFrame=checkpoint.number("lastchapterFrame");
+        chapterName=checkpoint.value("chapterName");
+        startDateTime=checkpoint.value("startDateTime");
+        endDateTime=checkpoint.value("endDateTime");
+        memset(&lastTime, 0, sizeof(struct tm));
+        sscanf(checkpoint.value("lastTime").toLatin1().constData(), "%d %d %d %d %d %d %d %d %d",
+               &lastTime.tm_year, &lastTime.tm_mon, &lastTime.tm_mday, &lastTime.tm_hour, &lastTime.tm_min,
+               &lastTime.tm_sec, &lastTime.tm_wday, &lastTime.tm_yday, &lastTime.tm_isdst);
+
+        for(it=chapterList.begin(); it!=chapterList.end(); ++it)
+            chapters.append(Chapter((*it).section(' ', 1), (*it).section(' ', 0, 0).toInt()));
+        for(it=titleList.begin(); it!=titleList.end(); ++it)
+            titles.append(Title((*it).section(' ', 1), (*it).section(' ', 0, 0)));
+
+        // Re-read the last frame output before the checkpoint, as the scene and dupe detectors compare against it
+        if(!(frame.data=seek(checkpoint.number("clip"), checkpoint.number("clipPos"))))
+        {
+            std::cerr << "ERROR: Failed to resume from " << QFile::encodeName(checkpointFile).constData() << std::endl;
+            exitFailed();
+        }
+
+        if(scenes || dupes)
+            frame.ExtractHeader();
+
+        if(scenes)
+        {
+            QList<CSceneDetector::Boundary> index;
+
+            for(it=sceneList.begin(); it!=sceneList.end(); ++it)
+                index.append(CSceneDetector::Boundary((*it).section(' ', 0, 0).toLongLong(), (*it).section(' ', 1).toInt()));
+            scenes->resume(index, checkpoint.number("lastCut"), frame);
+        }
+
+        if(dupes)
+        {
+            QList<CDupeDetector::Fault> index;
+
+            for(it=dupeList.begin(); it!=dupeList.end(); ++it)
+                index.append(CDupeDetector::Fault((*it).section(' ', 0, 0).toLongLong(), (*it).section(' ', 1, 1).toInt(),
+                                                  (*it).section(' ', 2, 2).toInt()));
+            dupes->resume(index, frame);
+        }
+    }
+
+    CProgress *progress=progressFd>=0 ? new CProgress(progressFd, stream ? 0 : itsTotalFrames, sinkThreads) : 0L;
+
+    if(progress)
+    {
+        progress->setFrames(frameCount+skipped);
+        progress->start();
+    }
+
+    // The length of a stream is not known, so its progress is the number of frames, and their duration
+    if(displayProgress && !stream)
         fprintf(stdErr, "  0%%     0fps");
 
     while((frame.data=nextFrame()))
     {
         frame.ExtractHeader();
-                
+
+        // Repeated frames are dropped before anything else sees them, so that all of the outputs agree
+        if(dupes && (dupes->process(frame, frameCount+skipped)&CDupeDetector::Repeat) && skipDupes)
+        {
+            skipped++;
+            if(progress)
+                progress->setFrames(frameCount+skipped);
+            continue;
+        }
+
         if((sub || dvda || kmf) && frame.GetRecordingDate(now) && timeDiff(&now, &lastTime, secondsInSubtitles))
         {
             const char *date=displayTime(sub, lastFrame, frameCount+1, &lastTime, adjust);
@@ -550,13 +1366,20 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
             memcpy(&lastTime, &now, sizeof(struct tm));
         }
 
+        int sceneReasons=scenes ? scenes->process(frame, frameCount) : CSceneDetector::None;
+
         if(dvda || kmf)
         {
             QString cName(currentChapterName(frameCount));
             bool    emptyName=cName.isEmpty(),
-                    diffName=!emptyName && cName!=chapterName;
-
-            if(0==frameCount%chapterGap || diffName)
+                    diffName=!emptyName && cName!=chapterName,
+                    // If detecting scenes, place chapters on shot boundaries - but keep them roughly chapterGap apart
+                    newChapter=scenes
+                                ? (CSceneDetector::None!=sceneReasons && (-1==lastchapterFrame || (frameCount-lastchapterFrame)>=chapterGap/2)) ||
+                                  (frameCount-lastchapterFrame)>=chapterGap*2
+                                : 0==frameCount%chapterGap;
+
+            if(newChapter || diffName)
             {
                 QString chapterStr(timeStr(frameCount, frameRate));
                 bool    tooClose=lastchapterFrame>-1 && (frameCount-lastchapterFrame)<minChapterGap,
@@ -584,41 +1407,83 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
             }
         }
 
-        if(wav)
+        if(!sinkThreads.isEmpty())
         {
-            if(!wavExp)
-            {
-                wavExp = new Wav(*wav);
-                if(!wavExp->Initialise(frame))
-                {
-                    std::cerr << "Failed to initialise audio file " << QFile::encodeName(wavFile).constData() << std::endl;
-                    return;
-                }
-            }
+            // One (implicitly shared) copy of the frame for all sinks, as the clip's buffer is re-used
+            QByteArray raw((const char *)frame.data, frame.GetFrameSize());
 
-            wavExp->Output(frame);
+            if(!outputToSinks(sinkThreads, raw, itsPlan.currentKey()))
+                break;
         }
 
-        if(yuv)
+        frameCount++;
+        if(progress)
+            progress->setFrames(frameCount+skipped);
+
+        if(!checkpointFile.isEmpty() && 0==frameCount%constCheckpointInterval)
         {
-            if(!yuvExp)
+            // Everything up to this frame must be on disk before the checkpoint says that it is
+            if(!drainSinks(sinkThreads))
+                break;
+            checkSync(sub);
+            checkSync(wav);
+            checkSync(yuv);
+
+            checkpoint.clear();
+            checkpoint.set("clip", itsPlan.currentClip());
+            checkpoint.set("clipPos", itsPlan.clipPosition());
+            checkpoint.set("frameCount", frameCount);
+            checkpoint.set("skipped", skipped);
+            checkpoint.set("lastFrame", lastFrame);
+            checkpoint.set("lastchapterFrame", lastchapterFrame);
+            checkpoint.set("chapterName", chapterName);
+            checkpoint.set("startDateTime", startDateTime);
+            checkpoint.set("endDateTime", endDateTime);
+            checkpoint.set("lastTime", QString().sprintf("%d %d %d %d %d %d %d %d %d",
+                                                         lastTime.tm_year, lastTime.tm_mon, lastTime.tm_mday, lastTime.tm_hour, lastTime.tm_min,
+                                                         lastTime.tm_sec, lastTime.tm_wday, lastTime.tm_yday, lastTime.tm_isdst));
+            if(sub)
+                checkpoint.set("sub", sub->position());
+            if(wav)
+                checkpoint.set("wav", wav->position());
+            if(yuv)
+                checkpoint.set("yuv", yuv->position());
+            for(int c=0; c<chapters.count(); ++c)
+                checkpoint.add("chapter", QString::number(chapters[c].frame)+' '+chapters[c].str);
+            for(int t=0; t<titles.count(); ++t)
+                checkpoint.add("title", titles[t].pos+' '+titles[t].name);
+            if(scenes)
             {
-                yuvExp = YUV420Extractor::GetExtractor(*yuv, deinterlace);
-                if(!yuvExp->Initialise(frame))
-                {
-                    std::cerr << "Failed to initialise yuv file " << QFile::encodeName(yuvFile).constData() << std::endl;
-                    return;
-                }
+                checkpoint.set("lastCut", scenes->lastCut());
+                for(int i=0; i<scenes->index().count(); ++i)
+                    checkpoint.add("scene", QString::number(scenes->index()[i].frame)+' '+QString::number(scenes->index()[i].reasons));
             }
+            if(dupes)
+                for(int i=0; i<dupes->index().count(); ++i)
+                    checkpoint.add("dupe", QString::number(dupes->index()[i].frame)+' '+QString::number(dupes->index()[i].reasons)+' '+
+                                           QString::number(dupes->index()[i].dropped));
 
-            yuvExp->Output(frame);
+            if(!checkpoint.save(checkpointFile))
+            {
+                std::cerr << "ERROR: Failed to save " << QFile::encodeName(checkpointFile).constData() << std::endl;
+                exitFailed();
+            }
         }
-        
-        frameCount++;
 
-        if(displayProgress && itsTotalFrames)
+        if(displayProgress && stream)
+        {
+            int secs=time(NULL);
+
+            if(secs!=lastProgress)
+            {
+                lastProgress=secs;
+                fprintf(stdErr, "\r%10lld frames  %s  %4dfps", (long long)frameCount, timeStr(frameCount, frameRate).toLatin1().constData(),
+                        secs>start ? (int)(frameCount/(secs-start)) : (int)frameCount);
+            }
+        }
+        else if(displayProgress && itsTotalFrames)
         {
-            currentProgress=(frameCount*100)/itsTotalFrames;
+            currentProgress=((frameCount+skipped)*100)/itsTotalFrames;
             if(currentProgress!=lastProgress)
             {
                 int diff=time(NULL)-start;
@@ -635,12 +1500,17 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
         stderr=stdErr;
     }
 
+    finishSinks(sinkThreads, progress);
+    delete progress;
+    delete CFrameCache::instance;
+    CFrameCache::instance=0L;
+
     if(devNull)
         fclose(devNull);
 
-    if((sub || dvda || kmf) && frameCount && lastFrame<totalFrames())
+    if((sub || dvda || kmf) && frameCount && lastFrame<totalFrames()-skipped)
     {
-        const char *date=displayTime(sub, lastFrame, totalFrames(), &lastTime, adjust);
+        const char *date=displayTime(sub, lastFrame, totalFrames()-skipped, &lastTime, adjust);
 
         if(date && dvda)
         {
@@ -650,6 +1520,32 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
         }
     }
 
+    if(scn)
+    {
+        QTextStream                                    str(scn, QIODevice::WriteOnly);
+        QList<CSceneDetector::Boundary>::ConstIterator it(scenes->index().begin()),
+                                                       end(scenes->index().end());
+
+        for(; it!=end; ++it)
+            str << (*it).frame << ' ' << timeStr((*it).frame, frameRate) << ' ' << CSceneDetector::reasonStr((*it).reasons) << endl;
+    }
+
+    // Frame numbers are those of the input, so that the faults can be found on the tape
+    if(dup)
+    {
+        QTextStream                                str(dup, QIODevice::WriteOnly);
+        QList<CDupeDetector::Fault>::ConstIterator it(dupes->index().begin()),
+                                                   end(dupes->index().end());
+
+        for(; it!=end; ++it)
+        {
+            str << (*it).frame << ' ' << timeStr((*it).frame, frameRate) << ' ' << CDupeDetector::reasonStr((*it).reasons);
+            if((*it).dropped)
+                str << ' ' << (*it).dropped;
+            str << endl;
+        }
+    }
+
     if(kmf)
     {
         QTextStream str(kmf, QIODevice::WriteOnly);
@@ -794,27 +1690,33 @@ void CClipList::output(const QString &subFile, const QString &dvdAuthorFile,
             title << startDate << " - " << endDate;
     }
 
-    if(wavExp)
-        wavExp->Flush();
-    if(yuvExp)
-        yuvExp->Flush();
     closeFile(dvda);
     closeFile(dvdc);
     closeFile(dvdt);
     closeFile(kmf);
+    closeFile(scn);
+    closeFile(dup);
+    delete scenes;
+    delete dupes;
     delete yuv;
     delete wav;
     delete sub;
+    delete shm;
+    delete plugins;
     delete yuvExp;
     delete wavExp;
+
+    // Finished, so there is nothing to resume
+    if(!checkpointFile.isEmpty())
+        QFile::remove(checkpointFile);
 }
 
 void CClipList::outputDv(const QString &file)
 {
-    CBufferedWriter out(file);
-    unsigned char   *data=0L;
     ConstIterator   firstClip(begin());
     int             frameSize((*firstClip).frameSize());
+    CBufferedWriter out(file, ((int64_t)totalFrames())*frameSize);
+    unsigned char   *data=0L;
     
     checkFile(&out);
     reset();
@@ -823,75 +1725,343 @@ void CClipList::outputDv(const QString &file)
         out.write(data, frameSize);
 }
 
-void CClipList::saveFrame(const QString &file, bool toGray, bool squareAspect)
+static const int constRgbSize=720 * 576 * 3;
+
+static QSize squareSize(const CClip &clip)
+{
+    return CClip::Normal==clip.format()
+            ? CClip::Ntsc==clip.type()
+                ? QSize(720, 540)
+                : QSize(768, 576)
+            : CClip::Ntsc==clip.type()
+                ? QSize(853, 480)
+                : QSize(1024, 576);
+}
+
+//
+// Decode frame into 'rgb', which needs to be large enough to hold a decoded PAL frame. At quality 0
+// only the DC coefficients are used, so the image is then 1/8 of the frame size.
+static QSize decode(Frame &f, unsigned char *rgb, bool deinterlace)
+{
+    if(0==CClipList::quality)
+    {
+        f.ExtractDCRGB(rgb);
+        return QSize(f.GetWidth()/8, f.GetHeight()/8);
+    }
+
+    f.SetPreferredQuality();
+    f.ExtractPreviewRGB(rgb, deinterlace);
+    return QSize(f.GetWidth(), f.GetHeight());
+}
+
+//
+// Convert a decoded frame into an RGB32 image, re-using 'image' if it is already the correct size.
+static void toImage(const unsigned char *rgb, const QSize &size, QImage &image, bool toGray)
+{
+    int width=size.width(),
+        height=size.height();
+
+    if(image.width()!=width || image.height()!=height || QImage::Format_RGB32!=image.format())
+        image=QImage(width, height, QImage::Format_RGB32);
+
+    for(int y=0; y<height; ++y)
+        if(toGray)
+            Kernels::rgbToGray(rgb+(y*width*3), image.scanLine(y), width);
+        else
+            Kernels::rgbToBgra(rgb+(y*width*3), image.scanLine(y), width);
+}
+
+//
+// Converts, scales, and saves, one picture of the 1st frame. Scaling and (mainly) PNG/JPEG encoding
+// take longer than the decode, so each picture is handled by its own thread.
+class CPictureSaver : public QRunnable
+{
+    public:
+
+    CPictureSaver(const CClipList::Picture &picture, const unsigned char *rgb, const QSize &decoded,
+                  const QSize &size, QAtomicInt &failed)
+        : itsPicture(picture), itsRgb(rgb), itsDecoded(decoded), itsSize(size), itsFailed(failed)
+    {
+    }
+
+    void run()
+    {
+        QImage image;
+
+        toImage(itsRgb, itsDecoded, image, itsPicture.toGray);
+        if(image.size()!=itsSize)
+            image=image.scaled(itsSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+        if(!image.save(itsPicture.file))
+            itsFailed.ref();
+    }
+
+    private:
+
+    CClipList::Picture  itsPicture;
+    const unsigned char *itsRgb;
+    QSize               itsDecoded,
+                        itsSize;
+    QAtomicInt          &itsFailed;
+};
+
+//
+// All of the pictures are of the 1st frame, so this is only read and decoded once.
+void CClipList::savePictures(const QList<Picture> &pictures)
 {
     reset();
 
     if((frame.data=nextFrame()))
     {
-        ConstIterator firstClip(begin());
-        unsigned char rgb[720 * 576 * 3],
-                      bgra[720 * 576 * 4];
-        int           s,
-                      d;
+        ConstIterator                 firstClip(begin());
+        unsigned char                 *rgb=new unsigned char[constRgbSize];
+        QList<Picture>::ConstIterator it(pictures.begin()),
+                                      end(pictures.end());
+        QThreadPool                   pool;
+        QAtomicInt                    failed(0);
+        QSize                         decoded;
 
         frame.ExtractHeader();
-        frame.ExtractPreviewRGB(rgb, CClip::Ntsc!=(*firstClip).type());
+        Frame::preferred_quality=dvQuality(quality);
+        decoded=decode(frame, rgb, CClip::Ntsc!=(*firstClip).type());
+
+        for(; it!=end; ++it)
+            pool.start(new CPictureSaver(*it, rgb, decoded, (*it).squareAspect
+                                                                ? squareSize(*firstClip)
+                                                                : QSize(frame.GetWidth(), frame.GetHeight()),
+                                         failed));
+        pool.waitForDone();
+        delete [] rgb;
+
+        if(0!=failed.load())
+        {
+            std::cerr << "ERROR: Failed to save picture" << std::endl;
+            exit(-1);
+        }
+    }
+    else
+    {
+        std::cerr << "ERROR: Failed to parse 1st frame";
+        exit(-2);
+    }
+}
 
-        for(s=0, d=0; s<frame.GetWidth() * frame.GetHeight() * 3; s+=3, d+=4)
+//
+// Decodes every 'step'th entry of the thumbnail list, starting at 'first'. Each worker has its own
+// Frame (and so libdv decoder), these are created on the main thread.
+class CThumbnailer : public QRunnable
+{
+    public:
+
+    struct Pos
+    {
+        const CClip *clip;
+        int64_t     frame,
+                    global;
+    };
+
+    CThumbnailer(const QList<Pos> &pos, QImage *images, const QString &dir, const QSize &size,
+                 bool deinterlace, int first, int step, QAtomicInt &failed)
+        : itsPos(pos), itsImages(images), itsDir(dir), itsSize(size), itsDeinterlace(deinterlace),
+          itsFirst(first), itsStep(step), itsFailed(failed)
+    {
+    }
+
+    void run()
+    {
+        unsigned char *raw=new unsigned char[CClip::constPalFrameSize],
+                      *rgb=new unsigned char[constRgbSize];
+        QImage        decoded;
+
+        itsFrame.data=raw;
+        for(int i=itsFirst; i<itsPos.count(); i+=itsStep)
         {
-            bgra[d+3]=0xFF;
-            if(toGray)
-                bgra[d]=bgra[d+1]=bgra[d+2]=(0.3*rgb[s]) + (0.59*rgb[s+1]) + (0.11*rgb[s+2]);
-            else
+            const Pos &pos(itsPos.at(i));
+
+            if(pos.clip->readFrame(pos.frame, raw))
             {
-                bgra[d]=rgb[s+2];
-                bgra[d+1]=rgb[s+1];
-                bgra[d+2]=rgb[s];
+                itsFrame.ExtractHeader();
+
+                toImage(rgb, decode(itsFrame, rgb, itsDeinterlace), decoded, false);
+
+                QImage image(decoded.scaled(itsSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+
+                if(itsImages)
+                    itsImages[i]=image;
+                else if(!image.save(itsDir+QString().sprintf("%08lld.png", (long long)pos.global)))
+                    itsFailed.ref();
             }
         }
-        QImage image(bgra, frame.GetWidth(), frame.GetHeight(), QImage::Format_RGB32);
 
-        if(squareAspect)
+        delete [] raw;
+        delete [] rgb;
+    }
+
+    private:
+
+    Frame           itsFrame;
+    QList<Pos>      itsPos;
+    QImage          *itsImages;
+    QString         itsDir;
+    QSize           itsSize;
+    bool            itsDeinterlace;
+    int             itsFirst,
+                    itsStep;
+    QAtomicInt      &itsFailed;
+};
+
+void CClipList::outputThumbnails(const QString &dest, int every)
+{
+    static const int constThumbHeight=144;
+    static const int constSheetColumns=8;
+
+    ConstIterator                  firstClip(begin());
+    int64_t                        interval=(int64_t)((every*(*firstClip).frameRate())+0.5);
+    int                            count;
+    QList<CThumbnailer::Pos>       pos;
+    bool                           sheet=Misc::checkExt(dest, "png") || Misc::checkExt(dest, "jpg");
+    QString                        dir(sheet ? QString() : Misc::dirSyntax(dest));
+    QSize                          size(squareSize(*firstClip));
+    QImage                         *images=0L;
+    QThreadPool                    pool;
+    QAtomicInt                     failed(0);
+
+    if(interval<1)
+        interval=1;
+    count=itsTotalFrames/interval;
+    if(!count)
+        count=1;
+
+    // Pick frames from the middle of each interval, and map these to clip positions...
+    ConstIterator it(begin()),
+                  e(end());
+    int64_t       clipStart=0;
+
+    for(int i=0; i<count && it!=e; ++i)
+    {
+        int64_t global=(i*interval)+(interval/2);
+
+        if(global>=itsTotalFrames)
+            global=itsTotalFrames-1;
+
+        while(it!=e && global>=clipStart+(*it).length())
         {
-            QSize size(CClip::Normal==(*firstClip).format()
-                        ? CClip::Ntsc==(*firstClip).type()
-                            ? QSize(720, 540)
-                            : QSize(768, 576)
-                        : CClip::Ntsc==(*firstClip).type()
-                            ? QSize(853, 480)
-                            : QSize(1024, 576));
-
-            image=image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            clipStart+=(*it).length();
+            ++it;
         }
 
-        image.save(file);
+        if(it!=e)
+        {
+            CThumbnailer::Pos p;
+
+            p.clip=&(*it);
+            p.frame=global-clipStart;
+            p.global=global;
+            pos.append(p);
+        }
     }
-    else
+
+    if(!sheet && !QDir().mkpath(dir))
     {
-        std::cerr << "ERROR: Failed to parse 1st frame";
-        exit(-2);
+        std::cerr << "ERROR: Failed to create " << QFile::encodeName(dest).constData() << std::endl;
+        exit(-1);
     }
-}
 
-unsigned char * CClipList::nextFrame()
-{
-    unsigned char *frame=0L;
+    if(sheet)
+        images=new QImage[pos.count()];
+
+    int workers=pool.maxThreadCount()<pos.count() ? pool.maxThreadCount() : pos.count();
+
+    Frame::preferred_quality=dvQuality(quality);
+    size=QSize((size.width()*constThumbHeight)/size.height(), constThumbHeight);
 
-    if(itsEnd!=itsCurrentClip)
+    for(int w=0; w<workers; ++w)
+        pool.start(new CThumbnailer(pos, images, dir, size, CClip::Ntsc!=(*firstClip).type(), w, workers,
+                                     failed));
+    pool.waitForDone();
+
+    if(0!=failed.load())
     {
-        frame=(*itsCurrentClip).nextFrame();
+        std::cerr << "ERROR: Failed to save thumbnail" << std::endl;
+        exit(-1);
+    }
 
-        if(!frame)
+    if(sheet)
+    {
+        int      columns=pos.count()<constSheetColumns ? pos.count() : constSheetColumns,
+                 rows=(pos.count()+columns-1)/columns;
+        QImage   contactSheet(columns*size.width(), rows*size.height(), QImage::Format_RGB32);
+        QPainter painter(&contactSheet);
+
+        contactSheet.fill(Qt::black);
+        for(int i=0; i<pos.count(); ++i)
+            if(!images[i].isNull())
+                painter.drawImage((i%columns)*size.width(), (i/columns)*size.height(), images[i]);
+        painter.end();
+
+        if(!contactSheet.save(dest))
         {
-            itsCurrentClip++;
-            frame=nextFrame();
+            std::cerr << "ERROR: Failed to create " << QFile::encodeName(dest).constData() << std::endl;
+            exit(-1);
         }
+        delete [] images;
     }
+}
 
+void CClipList::reset()
+{
+    ConstIterator it(begin()),
+                  endIt(end());
+
+    itsPlan.clear();
+    for(; it!=endIt; ++it)
+        itsPlan.add((*it).fileName(), (*it).from(), (*it).length(), (*it).frameSize(), (*it).stream(), (*it).container());
+    if(followTimeout>0)
+        itsPlan.follow(followTimeout);
+    itsCurrentClip=begin();
+}
+
+unsigned char * CClipList::nextFrame()
+{
+    unsigned char *frame=itsPlan.next();
+    int64_t       growth=itsPlan.takeGrowth();
+
+    if(growth)
+    {
+        last().grow(growth);
+        itsTotalFrames+=growth;
+    }
+
+    if(frame)
+        itsCurrentClip=begin()+itsPlan.currentClip();
+
+    return frame;
+}
+
+//
+// Continue reading from where currentClip() and clipPosition() were after frame 'pos'-1 of 'clip' was
+// read - that frame is returned again.
+unsigned char * CClipList::seek(int clip, int64_t pos)
+{
+    unsigned char *frame;
+
+    reset();
+    if(pos<1)
+        return 0L;
+
+    itsPlan.seek(clip, pos-1);
+    frame=itsPlan.next();
+    if(frame)
+        itsCurrentClip=begin()+itsPlan.currentClip();
     return frame;
 }
 
+void CClipList::outputPlan()
+{
+    reset();
+    itsPlan.dump(stdout);
+}
+
 void CClipList::saveToStream(QTextStream &str, bool simple) const
 {
     str << "<?xml version=\"1.0\"?>" << endl
@@ -1138,6 +2308,19 @@ bool CClipList::loadDv(const QString &f)
     return 0!=itsTotalFrames;
 }
 
+bool CClipList::loadStream(const QString &f)
+{
+    CClip clip(QSharedPointer<CStream>(new CStream(f)));
+
+    if(clip.isOk())
+    {
+        append(clip);
+        itsTotalFrames+=clip.length();
+    }
+
+    return 0!=itsTotalFrames;
+}
+
 const QString & CClipList::currentChapterName(int64_t frame)
 {
     return (*itsCurrentClip).chapter().isEmpty() && itsChapters.contains(frame)
@@ -23,10 +23,15 @@
 
 #include <QtCore/QFile>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QList>
 #include <QtCore/QByteArray>
 #include <QtCore/QHash>
+#include <QtCore/QSharedPointer>
 #include <stdint.h>
+#include "ReadPlan.h"
+#include "Stream.h"
+#include "Container.h"
 
 class QFile;
 class QTextStream;
@@ -55,7 +60,7 @@ class CClip
 
     CClip(const QString &fn=QString(), double f=-1.0, double t=-1, const QString &ch=QString());
     CClip(const QString &fn, int64_t f, int64_t t, const QString &ch=QString());
-    ~CClip()                              { reset(); }
+    CClip(const QSharedPointer<CStream> &stream);
 
     bool isOk() const                     { return -1!=itsLength; }
     bool similar(const CClip &other) const;
@@ -65,6 +70,8 @@ class CClip
     int64_t         from() const          { return itsFrom; }
     int64_t         to() const            { return itsTo; }
     int64_t         length() const        { return itsLength; }
+    // Whether the clip runs to the end of its file, rather than to an explicit 'to'
+    bool            toEnd() const         { return itsToEnd; }
     QString         duration() const;
     Type            type() const          { return itsType; }
     const char *    typeStr() const       { return Pal==itsType ? "pal" : "ntsc"; }
@@ -73,8 +80,13 @@ class CClip
     //bool            isProgressive() const { return itsProgressive; }
     double          frameRate() const     { return Pal==itsType ? constPalFps : constNtscFps; }
     int             frameSize() const     { return Pal==itsType ? constPalFrameSize : constNtscFrameSize; }
-    void            reset();
-    unsigned char * nextFrame();
+    CStream *       stream() const        { return itsStream.data(); }
+    CContainer *    container() const     { return itsContainer.data(); }
+    //
+    // Where frame 'f' of the file (not the clip) is
+    int64_t         offset(int64_t f) const { return itsContainer ? itsContainer->offset(f) : f*frameSize(); }
+    bool            readFrame(int64_t f, unsigned char *buffer, int count=1) const;
+    void            grow(int64_t frames)  { itsTo+=frames; itsLength+=frames; }
 
     private:
 
@@ -82,25 +94,47 @@ class CClip
 
     private:
 
-    int     itsFd;
     QString itsFileName,
             itsChapter;
     int64_t itsFrom,
             itsTo,
-            itsCurrent,
             itsLength;
+    bool    itsToEnd;
     Type    itsType;
     Format  itsFormat;
     //bool    itsProgressive;
+    QSharedPointer<CStream>    itsStream;
+    QSharedPointer<CContainer> itsContainer;
 };
 
 class CClipList : public QList<CClip>
 {
     public:
 
-    static char *subtitleFormat;
-    static bool displayProgress;
-    static int  deinterlace;
+    struct Picture
+    {
+        Picture(const QString &f, bool g, bool s) : file(f), toGray(g), squareAspect(s) { }
+
+        QString file;
+        bool    toGray,
+                squareAspect;
+    };
+
+    static char    *subtitleFormat;
+    static bool    displayProgress;
+    static int     progressFd;
+    static int     deinterlace;
+    static int     quality;
+    static int     resampler;
+    static int     audioRate;
+    static int     threads;
+    static int     cacheSize;
+    static QString cacheDir;
+    static bool    incremental;
+    static QString checkpointFile;
+    static bool    resume;
+    static int     followTimeout;
+    static bool    skipDupes;
 
     CClipList() : itsTotalFrames(0), itsCurrentClip(end()) { }
     CClipList(const QString &f)                            { load(f); }
@@ -112,6 +146,7 @@ class CClipList : public QList<CClip>
     bool            check() const;
     void            copy(const CClipList &other);
     int             totalFrames() const { return itsTotalFrames; }
+    bool            streaming() const;
     const QString & fileName() const    { return itsFileName; }
     QString         duration() const;
 
@@ -119,11 +154,15 @@ class CClipList : public QList<CClip>
     void            outputSpumux(const QString &file, const QString subFile=QString());
     void            output(const QString &subFile, const QString &dvdAuthorFile,
                            const QString &wavFile, const QString &yuvFile,
-                           const QString &kmfFile, int adjust);
+                           const QString &kmfFile, const QString &scenesFile, const QString &dupesFile,
+                           const QString &shmName, const QStringList &sinks, int adjust);
     void            outputDv(const QString &file);
-    void            saveFrame(const QString &file, bool toGray, bool squareAspect);
-    void            reset() { itsCurrentClip=begin(); itsEnd=end(); }
+    void            savePictures(const QList<Picture> &pictures);
+    void            outputThumbnails(const QString &dest, int every);
+    void            outputPlan();
+    void            reset();
     unsigned char * nextFrame();
+    unsigned char * seek(int clip, int64_t pos);
 
     private:
 
@@ -131,13 +170,17 @@ class CClipList : public QList<CClip>
     bool            loadKdenlive(const QString &file);
     bool            loadKino(const QString &file);
     bool            loadDv(const QString &file);
+    bool            loadStream(const QString &file);
     const QString & currentChapterName(int64_t frame);
+    bool            outputParallel(const QString &wavFile, const QString &yuvFile);
+    int64_t         expectedYuvSize() const;
+    int64_t         expectedWavSize() const;
 
     private:
 
     int                     itsTotalFrames;
-    iterator                itsCurrentClip,
-                            itsEnd;
+    iterator                itsCurrentClip;
+    CReadPlan               itsPlan;
     mutable QString         itsFileName;
     QHash<int64_t, QString> itsChapters;
 };
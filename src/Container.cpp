@@ -0,0 +1,508 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Container.h"
+#include "Clip.h"
+#include "Misc.h"
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+static const long pageSize=sysconf(_SC_PAGESIZE);
+
+static inline uint16_t le16(const unsigned char *p) { return p[0]|(p[1]<<8); }
+static inline uint32_t le32(const unsigned char *p) { return p[0]|(p[1]<<8)|(p[2]<<16)|(((uint32_t)p[3])<<24); }
+static inline uint64_t le64(const unsigned char *p) { return le32(p)|(((uint64_t)le32(p+4))<<32); }
+static inline uint32_t be32(const unsigned char *p) { return (((uint32_t)p[0])<<24)|(p[1]<<16)|(p[2]<<8)|p[3]; }
+static inline uint64_t be64(const unsigned char *p) { return (((uint64_t)be32(p))<<32)|be32(p+4); }
+static inline bool     is(const unsigned char *p, const char *fourcc) { return 0==memcmp(p, fourcc, 4); }
+
+//
+// The codecs, used by AVI and QuickTime, for 25Mbit DV
+static bool isDvFourcc(const unsigned char *p)
+{
+    static const char *constFourccs[]={ "dvsd", "dv25", "dvcs", "cdvc", "dvc ", "dvcp", "dvpp", 0L };
+
+    for(int i=0; constFourccs[i]; ++i)
+        if(0==strncasecmp((const char *)p, constFourccs[i], 4))
+            return true;
+    return false;
+}
+
+bool CContainer::isContainer(const QString &name)
+{
+    QString lower(name.toLower());
+
+    return Misc::checkExt(lower, "avi") || Misc::checkExt(lower, "mov") || Misc::checkExt(lower, "qt");
+}
+
+// How many files CContainer::open() keeps mapped
+static const int constMaxOpen=32;
+
+struct COpenContainer
+{
+    uint64_t                   device,
+                               inode;
+    int64_t                    size,
+                               mtime;
+    QSharedPointer<CContainer> container;
+};
+
+static QHash<QString, COpenContainer> openContainers;
+static QList<QString>                 openOrder; // Least recently used first
+
+QSharedPointer<CContainer> CContainer::open(const QString &name)
+{
+    struct stat64 info;
+
+    if(0!=stat64(QFile::encodeName(name).constData(), &info))
+        return QSharedPointer<CContainer>(new CContainer(name));
+
+    int64_t mtime=(((int64_t)info.st_mtim.tv_sec)*1000000000)+info.st_mtim.tv_nsec;
+
+    openOrder.removeOne(name);
+    if(openContainers.contains(name))
+    {
+        const COpenContainer &kept(openContainers[name]);
+
+        if(kept.device==(uint64_t)info.st_dev && kept.inode==(uint64_t)info.st_ino && kept.size==info.st_size && kept.mtime==mtime)
+        {
+            openOrder.append(name);
+            return kept.container;
+        }
+        openContainers.remove(name);
+    }
+
+    COpenContainer entry;
+
+    entry.device=info.st_dev;
+    entry.inode=info.st_ino;
+    entry.size=info.st_size;
+    entry.mtime=mtime;
+    entry.container=QSharedPointer<CContainer>(new CContainer(name));
+
+    if(entry.container->isOk())
+    {
+        openContainers.insert(name, entry);
+        openOrder.append(name);
+        if(openOrder.count()>constMaxOpen)
+            openContainers.remove(openOrder.takeFirst());
+    }
+
+    return entry.container;
+}
+
+CContainer::CContainer(const QString &name)
+          : itsMap(0L),
+            itsSize(0),
+            itsMtime(0),
+            itsDevice(0),
+            itsInode(0),
+            itsFrameSize(0)
+{
+    int fd=open64(QFile::encodeName(name).constData(), O_RDONLY|O_LARGEFILE);
+
+    if(-1==fd)
+        return;
+
+    struct stat64 info;
+
+    if(0==fstat64(fd, &info) && info.st_size>0)
+    {
+        void *map=mmap64(0L, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if(MAP_FAILED!=map)
+        {
+            itsMap=(unsigned char *)map;
+            itsSize=info.st_size;
+            itsMtime=(((int64_t)info.st_mtim.tv_sec)*1000000000)+info.st_mtim.tv_nsec;
+            itsDevice=info.st_dev;
+            itsInode=info.st_ino;
+        }
+    }
+
+    // The mapping holds its own reference to the file
+    close(fd);
+
+    if(itsMap)
+    {
+        if(!(Misc::checkExt(name.toLower(), "avi") ? loadAvi() : loadMov()))
+            itsOffsets.clear();
+
+        // The index is read at random, but the frames are then read in order
+        madvise(itsMap, itsSize, MADV_SEQUENTIAL);
+    }
+}
+
+CContainer::~CContainer()
+{
+    if(itsMap)
+        munmap(itsMap, itsSize);
+}
+
+void CContainer::willNeed(int64_t from, int64_t count) const
+{
+    if(from<0 || from>=frames() || count<=0)
+        return;
+    if(from+count>frames())
+        count=frames()-from;
+
+    int64_t start=(offset(from)/pageSize)*pageSize,
+            end=offset(from+count-1)+itsFrameSize;
+
+    if(end>start)
+        madvise(itsMap+start, end-start, MADV_WILLNEED);
+}
+
+//
+// Every frame must be a whole 25Mbit DV frame, of the same size as the 1st. A size of 0 is a
+// dropped frame, for which the previous frame is repeated. Returns false if the frame is not valid,
+// in which case the index is read no further.
+bool CContainer::addFrame(int64_t pos, int64_t size)
+{
+    if(0==size)
+    {
+        if(!itsOffsets.isEmpty())
+            itsOffsets.append(itsOffsets.last());
+        return true;
+    }
+
+    if(0==itsFrameSize)
+    {
+        if(CClip::constPalFrameSize!=size && CClip::constNtscFrameSize!=size)
+            return false;
+        itsFrameSize=size;
+    }
+
+    if(size!=itsFrameSize || !has(pos, size))
+        return false;
+
+    itsOffsets.append(pos);
+    return true;
+}
+
+//
+// The 1st RIFF chunk holds the headers, the 'movi' list of data chunks, and the idx1 index. Files
+// larger than 1GB continue in OpenDML 'AVIX' RIFF chunks, which are only found via the OpenDML index.
+bool CContainer::loadAvi()
+{
+    int64_t indx=-1,
+            idx1=-1,
+            idx1Size=0,
+            movi=-1,
+            moviEnd=-1;
+    int     stream=-1;
+
+    if(!has(0, 12) || !is(itsMap, "RIFF") || !is(itsMap+8, "AVI "))
+        return false;
+
+    for(int64_t end=8+le32(itsMap+4), child=12; has(child, 8) && child<end;)
+    {
+        const unsigned char *c=itsMap+child;
+        int64_t             size=le32(c+4);
+
+        if(is(c, "LIST") && has(child, 12) && is(c+8, "hdrl"))
+            stream=aviStream(child+12, child+8+size, indx);
+        else if(is(c, "LIST") && has(child, 12) && is(c+8, "movi"))
+        {
+            movi=child+8;
+            moviEnd=child+8+size;
+        }
+        else if(is(c, "idx1"))
+        {
+            idx1=child+8;
+            idx1Size=size;
+        }
+        child+=8+size+(size&1);
+    }
+
+    if(stream<0)
+        return false;
+
+    char id[3];
+
+    // Data chunks are identified by the stream number, followed by 2 letters
+    sprintf(id, "%02d", stream%100);
+
+    if(indx>=0 && loadAviOpenDml(indx))
+        return true;
+
+    itsOffsets.clear();
+    itsFrameSize=0;
+    if(idx1>=0 && movi>=0 && loadAviIdx1(idx1, idx1Size, movi, id))
+        return true;
+
+    // No usable index, so walk the data chunks
+    itsOffsets.clear();
+    itsFrameSize=0;
+    if(movi>=0)
+        scanAviMovi(movi+4, moviEnd, id);
+
+    return isOk();
+}
+
+//
+// Find the DV stream in the 'hdrl' list - either an interleaved (type 1) stream, or a DV video (type 2)
+// stream. Returns its number, and sets 'indx' to the position of its OpenDML index, if it has one.
+int CContainer::aviStream(int64_t pos, int64_t end, int64_t &indx)
+{
+    for(int num=0; has(pos, 12) && pos<end;)
+    {
+        const unsigned char *c=itsMap+pos;
+        int64_t             size=le32(c+4);
+
+        if(is(c, "LIST") && is(c+8, "strl"))
+        {
+            bool    video=false,
+                    dv=false;
+            int64_t streamIndx=-1;
+
+            for(int64_t child=pos+12, strlEnd=pos+8+size; has(child, 8) && child<strlEnd;)
+            {
+                const unsigned char *s=itsMap+child;
+                int64_t             sSize=le32(s+4);
+
+                if(is(s, "strh") && has(child+8, 8))
+                {
+                    dv=is(s+8, "iavs") || (is(s+8, "vids") && isDvFourcc(s+12));
+                    video=is(s+8, "vids");
+                }
+                else if(is(s, "strf") && video && !dv && has(child+8, 20))
+                    dv=isDvFourcc(s+8+16); // BITMAPINFOHEADER.biCompression
+                else if(is(s, "indx"))
+                    streamIndx=child+8;
+                child+=8+sSize+(sSize&1);
+            }
+
+            if(dv)
+            {
+                indx=streamIndx;
+                return num;
+            }
+            num++;
+        }
+        pos+=8+size+(size&1);
+    }
+
+    return -1;
+}
+
+//
+// An OpenDML super index lists the standard (ix##) indexes of the stream. These hold 32 bit offsets
+// from a 64 bit base, so can index files of any size.
+bool CContainer::loadAviOpenDml(int64_t indx)
+{
+    if(!has(indx, 24) || 4!=le16(itsMap+indx) || 0!=itsMap[indx+3]) // AVI_INDEX_OF_INDEXES
+        return false;
+
+    uint32_t entries=le32(itsMap+indx+4);
+
+    for(uint32_t e=0; e<entries && has(indx+24+(e*16), 16); ++e)
+    {
+        int64_t             ix=le64(itsMap+indx+24+(e*16));
+        const unsigned char *s=itsMap+ix;
+
+        if(!has(ix, 32) || 2!=le16(s+8) || 1!=s[11]) // AVI_INDEX_OF_CHUNKS
+            break;
+
+        uint32_t count=le32(s+12);
+        int64_t  base=le64(s+20);
+
+        for(uint32_t i=0; i<count && has(ix+32+(i*8), 8); ++i)
+            if(!addFrame(base+le32(s+32+(i*8)), le32(s+36+(i*8))&0x7FFFFFFF)) // Top bit is the 'not a key frame' flag
+                return isOk();
+    }
+
+    return isOk();
+}
+
+bool CContainer::loadAviIdx1(int64_t pos, int64_t size, int64_t movi, const char *id)
+{
+    int64_t base=-1;
+
+    for(int64_t e=pos; e+16<=pos+size && has(e, 16); e+=16)
+    {
+        const unsigned char *entry=itsMap+e;
+
+        if(0!=memcmp(entry, id, 2))
+            continue;
+
+        int64_t offset=le32(entry+8);
+
+        // Offsets should be relative to the 'movi' list, but some files have absolute offsets
+        if(-1==base)
+            base=has(offset, 4) && is(itsMap+offset, (const char *)entry) ? 0 : movi;
+
+        if(!addFrame(base+offset+8, le32(entry+12)))
+            break;
+    }
+
+    return isOk();
+}
+
+void CContainer::scanAviMovi(int64_t pos, int64_t end, const char *id)
+{
+    while(has(pos, 8) && pos<end)
+    {
+        const unsigned char *c=itsMap+pos;
+        int64_t             size=le32(c+4);
+
+        // Chunks may be grouped into 'rec ' lists - these are just stepped into
+        if(is(c, "LIST"))
+        {
+            pos+=12;
+            continue;
+        }
+
+        if(0==memcmp(c, id, 2) && !addFrame(pos+8, size))
+            return;
+        pos+=8+size+(size&1);
+    }
+}
+
+//
+// Returns the size of the atom at 'pos', including its header - whose size is put in 'header'. A
+// size of 0 means the atom runs to 'end'.
+int64_t CContainer::atom(int64_t pos, int64_t end, int &header) const
+{
+    if(!has(pos, 8) || pos+8>end)
+        return 0;
+
+    int64_t size=be32(itsMap+pos);
+
+    header=8;
+    if(1==size && has(pos, 16))
+    {
+        size=be64(itsMap+pos+8);
+        header=16;
+    }
+    else if(0==size)
+        size=end-pos;
+
+    return size>=header && pos+size<=end ? size : 0;
+}
+
+//
+// Find the 1st atom of 'type' between 'pos' and 'end'. Returns the position of its contents, and
+// sets 'atomEnd' - or returns -1.
+int64_t CContainer::findAtom(int64_t pos, int64_t end, const char *type, int64_t &atomEnd) const
+{
+    int     header;
+    int64_t size;
+
+    for(; (size=atom(pos, end, header))>0; pos+=size)
+        if(is(itsMap+pos+4, type))
+        {
+            atomEnd=pos+size;
+            return pos+header;
+        }
+
+    return -1;
+}
+
+bool CContainer::loadMov()
+{
+    int64_t moovEnd,
+            moov=findAtom(0, itsSize, "moov", moovEnd),
+            size;
+    int     header;
+
+    if(moov<0)
+        return false;
+
+    // Use the 1st DV track
+    for(int64_t pos=moov; (size=atom(pos, moovEnd, header))>0; pos+=size)
+        if(is(itsMap+pos+4, "trak") && loadMovTrack(pos+header, pos+size))
+            return true;
+
+    return false;
+}
+
+//
+// The sample tables give the size of each sample (stsz), which chunk each sample is in (stsc), and
+// where each chunk is (stco, or co64 for files larger than 4GB).
+bool CContainer::loadMovTrack(int64_t pos, int64_t end)
+{
+    int64_t mdiaEnd=0,
+            minfEnd=0,
+            stblEnd=0,
+            stsdEnd,
+            mdia=findAtom(pos, end, "mdia", mdiaEnd),
+            minf=mdia<0 ? -1 : findAtom(mdia, mdiaEnd, "minf", minfEnd),
+            stbl=minf<0 ? -1 : findAtom(minf, minfEnd, "stbl", stblEnd),
+            stsd=stbl<0 ? -1 : findAtom(stbl, stblEnd, "stsd", stsdEnd);
+
+    // Version and flags, the number of entries, and then the 1st entry's size and format
+    if(stsd<0 || !has(stsd, 16) || !isDvFourcc(itsMap+stsd+12))
+        return false;
+
+    int64_t atomEnd,
+            stsz=findAtom(stbl, stblEnd, "stsz", atomEnd),
+            stsc=findAtom(stbl, stblEnd, "stsc", atomEnd),
+            stco=findAtom(stbl, stblEnd, "stco", atomEnd);
+    int     offsetSize=4;
+
+    if(stco<0)
+    {
+        stco=findAtom(stbl, stblEnd, "co64", atomEnd);
+        offsetSize=8;
+    }
+
+    if(stsz<0 || stsc<0 || stco<0 || !has(stsz, 12) || !has(stsc, 8) || !has(stco, 8))
+        return false;
+
+    uint32_t sampleSize=be32(itsMap+stsz+4),
+             samples=be32(itsMap+stsz+8),
+             entries=be32(itsMap+stsc+4),
+             chunks=be32(itsMap+stco+4),
+             sample=0;
+
+    for(uint32_t c=0, e=0; c<chunks && sample<samples; ++c)
+    {
+        // Each stsc entry gives the samples per chunk from its (1 based) 1st chunk onwards
+        while(e+1<entries && has(stsc+8+((e+1)*12), 12) && be32(itsMap+stsc+8+((e+1)*12))<=c+1)
+            e++;
+
+        if(!has(stsc+8+(e*12), 12) || !has(stco+8+(c*offsetSize), offsetSize))
+            break;
+
+        uint32_t perChunk=be32(itsMap+stsc+8+(e*12)+4);
+        int64_t  offset=8==offsetSize ? be64(itsMap+stco+8+(c*8)) : be32(itsMap+stco+8+(c*4));
+
+        for(uint32_t s=0; s<perChunk && sample<samples; ++s, ++sample)
+        {
+            int64_t size=sampleSize ? sampleSize : has(stsz+12+(sample*4), 4) ? be32(itsMap+stsz+12+(sample*4)) : -1;
+
+            if(size<=0 || !addFrame(offset, size))
+                return isOk();
+            offset+=size;
+        }
+    }
+
+    return isOk();
+}
@@ -0,0 +1,86 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QSharedPointer>
+#include <stdint.h>
+
+//
+// DV held in an AVI (type 1 or 2) or QuickTime file. The file is mapped into memory, and the offset
+// of each DV frame is read from its index - the OpenDML index, or idx1, of an AVI, or the sample
+// tables of a MOV. Frames are then used straight from the mapping, so there is no need to remux the
+// file to raw DV first.
+class CContainer
+{
+    public:
+
+    static bool isContainer(const QString &name);
+    //
+    // Containers are kept, keyed on their name, until the file changes - so that a file used by more
+    // than one clip, or (by a --serve server) more than one job, only has its index read once. Only
+    // to be called from the main thread.
+    static QSharedPointer<CContainer> open(const QString &name);
+
+    CContainer(const QString &name);
+    ~CContainer();
+
+    bool                  isOk() const               { return !itsOffsets.isEmpty(); }
+    int64_t               frames() const             { return itsOffsets.count(); }
+    int                   frameSize() const          { return itsFrameSize; }
+    int64_t               offset(int64_t f) const    { return itsOffsets[f]; }
+    const unsigned char * frame(int64_t f) const     { return itsMap+itsOffsets[f]; }
+    uint64_t              device() const             { return itsDevice; }
+    uint64_t              inode() const              { return itsInode; }
+    int64_t               fileSize() const           { return itsSize; }
+    int64_t               mtime() const              { return itsMtime; }
+    //
+    // Ask the kernel to start reading frames 'from' to 'from'+'count'-1
+    void                  willNeed(int64_t from, int64_t count) const;
+
+    private:
+
+    bool                  has(int64_t pos, int64_t len) const { return pos>=0 && len>=0 && pos+len<=itsSize; }
+    bool                  addFrame(int64_t pos, int64_t size);
+    bool                  loadAvi();
+    int                   aviStream(int64_t pos, int64_t end, int64_t &indx);
+    bool                  loadAviOpenDml(int64_t indx);
+    bool                  loadAviIdx1(int64_t pos, int64_t size, int64_t movi, const char *id);
+    void                  scanAviMovi(int64_t pos, int64_t end, const char *id);
+    int64_t               atom(int64_t pos, int64_t end, int &header) const;
+    int64_t               findAtom(int64_t pos, int64_t end, const char *type, int64_t &atomEnd) const;
+    bool                  loadMov();
+    bool                  loadMovTrack(int64_t pos, int64_t end);
+
+    private:
+
+    unsigned char    *itsMap;
+    int64_t          itsSize,
+                     itsMtime;  // ns
+    uint64_t         itsDevice,
+                     itsInode;
+    int              itsFrameSize;
+    QVector<int64_t> itsOffsets;
+};
+
+#endif
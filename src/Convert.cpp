@@ -0,0 +1,123 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Convert.h"
+
+#ifdef HAVE_X86_KERNELS
+#include <tmmintrin.h>
+#endif
+
+namespace Convert
+{
+
+// Luma weights, in 1/128ths - small enough for the signed bytes of pmaddubsw
+static const int constWeightR=38;
+static const int constWeightG=75;
+static const int constWeightB=15;
+
+void rgbToBgraC(const unsigned char *rgb, unsigned char *bgra, int pixels)
+{
+    for(int i=0; i<pixels; ++i, rgb+=3, bgra+=4)
+    {
+        bgra[0]=rgb[2];
+        bgra[1]=rgb[1];
+        bgra[2]=rgb[0];
+        bgra[3]=0xFF;
+    }
+}
+
+void rgbToGrayC(const unsigned char *rgb, unsigned char *bgra, int pixels)
+{
+    for(int i=0; i<pixels; ++i, rgb+=3, bgra+=4)
+    {
+        bgra[0]=bgra[1]=bgra[2]=((constWeightR*rgb[0])+(constWeightG*rgb[1])+(constWeightB*rgb[2])+64)>>7;
+        bgra[3]=0xFF;
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+//
+// Converts 16 pixels (48 bytes of RGB) into 4 registers of 4 BGRA pixels each.
+__attribute__((target("ssse3")))
+static inline void load16(const unsigned char *rgb, __m128i out[4])
+{
+    const __m128i swizzle=_mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128),
+                  alpha=_mm_set1_epi32(0xFF000000);
+    __m128i       in0=_mm_loadu_si128((const __m128i *)rgb),
+                  in1=_mm_loadu_si128((const __m128i *)(rgb+16)),
+                  in2=_mm_loadu_si128((const __m128i *)(rgb+32));
+
+    out[0]=_mm_or_si128(_mm_shuffle_epi8(in0, swizzle), alpha);
+    out[1]=_mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), swizzle), alpha);
+    out[2]=_mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), swizzle), alpha);
+    out[3]=_mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(in2, 4), swizzle), alpha);
+}
+
+__attribute__((target("ssse3")))
+void rgbToBgraSsse3(const unsigned char *rgb, unsigned char *bgra, int pixels)
+{
+    int i=0;
+
+    for(; i+16<=pixels; i+=16, rgb+=48, bgra+=64)
+    {
+        __m128i out[4];
+
+        load16(rgb, out);
+        _mm_storeu_si128((__m128i *)bgra, out[0]);
+        _mm_storeu_si128((__m128i *)(bgra+16), out[1]);
+        _mm_storeu_si128((__m128i *)(bgra+32), out[2]);
+        _mm_storeu_si128((__m128i *)(bgra+48), out[3]);
+    }
+
+    rgbToBgraC(rgb, bgra, pixels-i);
+}
+
+__attribute__((target("ssse3")))
+void rgbToGraySsse3(const unsigned char *rgb, unsigned char *bgra, int pixels)
+{
+    const __m128i weights=_mm_setr_epi8(constWeightB, constWeightG, constWeightR, 0, constWeightB, constWeightG, constWeightR, 0,
+                                        constWeightB, constWeightG, constWeightR, 0, constWeightB, constWeightG, constWeightR, 0),
+                  ones=_mm_set1_epi16(1),
+                  round=_mm_set1_epi32(64),
+                  spread=_mm_setr_epi8(0, 0, 0, -128, 4, 4, 4, -128, 8, 8, 8, -128, 12, 12, 12, -128),
+                  alpha=_mm_set1_epi32(0xFF000000);
+    int           i=0;
+
+    for(; i+16<=pixels; i+=16, rgb+=48, bgra+=64)
+    {
+        __m128i out[4];
+
+        load16(rgb, out);
+        for(int o=0; o<4; ++o)
+        {
+            __m128i luma=_mm_madd_epi16(_mm_maddubs_epi16(out[o], weights), ones);
+
+            luma=_mm_srli_epi32(_mm_add_epi32(luma, round), 7);
+            _mm_storeu_si128((__m128i *)(bgra+(o*16)), _mm_or_si128(_mm_shuffle_epi8(luma, spread), alpha));
+        }
+    }
+
+    rgbToGrayC(rgb, bgra, pixels-i);
+}
+
+#endif
+
+}
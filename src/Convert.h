@@ -0,0 +1,39 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Kernels.h"
+
+//
+// Pixel conversion kernels. 'bgra' is in the byte order of QImage::Format_RGB32 on little endian
+// machines, with alpha set to 0xFF. Use these via Kernels::rgbToBgra and Kernels::rgbToGray.
+namespace Convert
+{
+    extern void rgbToBgraC(const unsigned char *rgb, unsigned char *bgra, int pixels);
+    extern void rgbToGrayC(const unsigned char *rgb, unsigned char *bgra, int pixels);
+#ifdef HAVE_X86_KERNELS
+    extern void rgbToBgraSsse3(const unsigned char *rgb, unsigned char *bgra, int pixels);
+    extern void rgbToGraySsse3(const unsigned char *rgb, unsigned char *bgra, int pixels);
+#endif
+}
+
+#endif
@@ -0,0 +1,231 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "DupeDetector.h"
+#include "SceneDetector.h"
+#include "Frame.h"
+#include <string.h>
+
+static const int constDifBlockSize=80;
+
+static const uint64_t constPrime1=0x9E3779B185EBCA87ULL;
+static const uint64_t constPrime2=0xC2B2AE3D27D4EB4FULL;
+static const uint64_t constPrime3=0x165667B19E3779F9ULL;
+static const uint64_t constPrime4=0x85EBCA77C2B2AE63ULL;
+static const uint64_t constPrime5=0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t v, int bits)
+{
+    return (v<<bits)|(v>>(64-bits));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    return rotl(acc+input*constPrime2, 31)*constPrime1;
+}
+
+static inline uint64_t merge(uint64_t acc, uint64_t v)
+{
+    return (acc^round(0, v))*constPrime1+constPrime4;
+}
+
+//
+// The 4 lanes of the main loop are independent, so the CPU can overlap them - this hashes a frame
+// in much less time than it takes to read it.
+uint64_t CDupeDetector::hash(const unsigned char *data, int size, uint64_t seed)
+{
+    const unsigned char *p=data,
+                        *end=data+size;
+    uint64_t            h;
+
+    if(size>=32)
+    {
+        uint64_t v1=seed+constPrime1+constPrime2,
+                 v2=seed+constPrime2,
+                 v3=seed,
+                 v4=seed-constPrime1;
+
+        for(; p+32<=end; p+=32)
+        {
+            v1=round(v1, read64(p));
+            v2=round(v2, read64(p+8));
+            v3=round(v3, read64(p+16));
+            v4=round(v4, read64(p+24));
+        }
+
+        h=rotl(v1, 1)+rotl(v2, 7)+rotl(v3, 12)+rotl(v4, 18);
+        h=merge(h, v1);
+        h=merge(h, v2);
+        h=merge(h, v3);
+        h=merge(h, v4);
+    }
+    else
+        h=seed+constPrime5;
+
+    h+=(uint64_t)size;
+
+    for(; p+8<=end; p+=8)
+        h=rotl(h^round(0, read64(p)), 27)*constPrime1+constPrime4;
+
+    if(p+4<=end)
+    {
+        h=rotl(h^(read32(p)*constPrime1), 23)*constPrime2+constPrime3;
+        p+=4;
+    }
+
+    for(; p<end; ++p)
+        h=rotl(h^(*p*constPrime5), 11)*constPrime1;
+
+    h^=h>>33;
+    h*=constPrime2;
+    h^=h>>29;
+    h*=constPrime3;
+    h^=h>>32;
+    return h;
+}
+
+QString CDupeDetector::reasonStr(int reasons)
+{
+    QString str;
+
+    if(reasons&Repeat)
+        str+=",repeat";
+    if(reasons&TimeCodeRepeat)
+        str+=",tcrepeat";
+    if(reasons&Dropped)
+        str+=",dropped";
+
+    return str.isEmpty() ? str : str.mid(1);
+}
+
+CDupeDetector::CDupeDetector()
+             : itsLastHash(0),
+               itsLastTimeCode(-1),
+               itsHaveHash(false)
+{
+}
+
+int CDupeDetector::process(const Frame &frame, int64_t frameNum)
+{
+    uint64_t h=videoHash(frame);
+    int      dropped=0,
+             reasons=(itsHaveHash && h==itsLastHash ? Repeat : None) |
+                     timeCode(frame, dropped);
+
+    itsLastHash=h;
+    itsHaveHash=true;
+
+    if(None!=reasons)
+        itsIndex.append(Fault(frameNum, reasons, dropped));
+
+    return reasons;
+}
+
+//
+// Carry on from a --checkpoint. 'previous' is the last frame processed before the checkpoint, and is
+// only used to compare the next frame against.
+void CDupeDetector::resume(const QList<Fault> &index, const Frame &previous)
+{
+    int dropped;
+
+    itsIndex=index;
+    itsLastHash=videoHash(previous);
+    itsHaveHash=true;
+    timeCode(previous, dropped);
+}
+
+//
+// Only the video DIF blocks are hashed, as the subcode (timecode) and VAUX (recording date) blocks
+// of a repeated frame may have been re-written by the deck. Within each DIF sequence the video blocks
+// come in runs of 15, between the audio blocks, and each run is hashed in one go.
+uint64_t CDupeDetector::videoHash(const Frame &frame) const
+{
+    const unsigned char *block=frame.data,
+                        *end=frame.data+frame.GetFrameSize(),
+                        *run=0L;
+    uint64_t            h=0;
+
+    for(; block<end; block+=constDifBlockSize)
+        if(0x80==(block[0]&0xE0)) // Video DIF block
+        {
+            if(!run)
+                run=block;
+        }
+        else if(run)
+        {
+            h=hash(run, block-run, h);
+            run=0L;
+        }
+
+    if(run)
+        h=hash(run, end-run, h);
+
+    return h;
+}
+
+int CDupeDetector::timeCode(const Frame &frame, int &dropped)
+{
+    TimeCode tc;
+
+    if(!frame.GetTimeCode(tc) || !CSceneDetector::isValid(tc))
+        return None;
+
+    bool    pal=frame.IsPAL();
+    int64_t current=CSceneDetector::toFrames(tc, pal),
+            diff=current-itsLastTimeCode;
+    bool    first=-1==itsLastTimeCode;
+
+    itsLastTimeCode=current;
+
+    if(first)
+        return None;
+
+    // NTSC drop frame timecode skips frames 0 and 1 at the start of each minute, except every 10th
+    if(!pal && 3==diff && 0==tc.sec && 2==tc.frame && 0!=tc.min%10)
+        diff=1;
+
+    if(0==diff)
+        return TimeCodeRepeat;
+
+    // Larger jumps are recording breaks, as found by --scenes
+    if(diff>1 && diff<=(pal ? 25 : 30))
+    {
+        dropped=diff-1;
+        return Dropped;
+    }
+
+    return None;
+}
@@ -0,0 +1,82 @@
+#ifndef DUPE_DETECTOR_H
+#define DUPE_DETECTOR_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <stdint.h>
+
+class Frame;
+
+//
+// Finds the faults of captures from worn tapes, without decoding the video. A frame is a repeat if
+// its compressed video is the same as that of the previous frame - as happens when the deck repeats
+// a frame on dropout. The timecode is also checked, to find frames that repeat it, and gaps where
+// frames were dropped.
+class CDupeDetector
+{
+    public:
+
+    enum Reason
+    {
+        None           = 0x00,
+        Repeat         = 0x01,
+        TimeCodeRepeat = 0x02,
+        Dropped        = 0x04
+    };
+
+    struct Fault
+    {
+        Fault(int64_t f=0, int r=None, int d=0) : frame(f), reasons(r), dropped(d) { }
+
+        int64_t frame;
+        int     reasons,
+                dropped; // Number of frames missing before this one
+    };
+
+    //
+    // XXH64 of 'size' bytes
+    static uint64_t hash(const unsigned char *data, int size, uint64_t seed=0);
+    static QString  reasonStr(int reasons);
+
+    CDupeDetector();
+
+    //
+    // Frame headers must already have been parsed, i.e. frame.ExtractHeader()
+    int                  process(const Frame &frame, int64_t frameNum);
+    void                 resume(const QList<Fault> &index, const Frame &previous);
+    const QList<Fault> & index() const { return itsIndex; }
+
+    private:
+
+    uint64_t             videoHash(const Frame &frame) const;
+    int                  timeCode(const Frame &frame, int &dropped);
+
+    private:
+
+    QList<Fault> itsIndex;
+    uint64_t     itsLastHash;
+    int64_t      itsLastTimeCode;
+    bool         itsHaveHash;
+};
+
+#endif
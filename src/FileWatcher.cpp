@@ -0,0 +1,119 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "FileWatcher.h"
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+CFileWatcher::CFileWatcher(const QString &name, int timeout)
+            : itsName(name),
+              itsBaseName(QFile::encodeName(QFileInfo(name).fileName())),
+              itsFd(inotify_init1(IN_CLOEXEC)),
+              itsTimeout(timeout),
+              itsClosed(false),
+              itsSize(0)
+{
+    if(-1!=itsFd &&
+       -1==inotify_add_watch(itsFd, QFile::encodeName(QFileInfo(name).absolutePath()).constData(), IN_MODIFY|IN_CLOSE_WRITE|IN_CREATE))
+    {
+        close(itsFd);
+        itsFd=-1;
+    }
+}
+
+CFileWatcher::~CFileWatcher()
+{
+    if(-1!=itsFd)
+        close(itsFd);
+}
+
+static int64_t msecs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((int64_t)ts.tv_sec)*1000)+(ts.tv_nsec/1000000);
+}
+
+bool CFileWatcher::waitFor(int64_t size)
+{
+    int64_t lastGrowth=msecs();
+
+    for(;;)
+    {
+        struct stat64 info;
+
+        // The watch is in place before the size is checked, so no write can be missed
+        if(0==stat64(QFile::encodeName(itsName).constData(), &info) && info.st_size!=itsSize)
+        {
+            itsSize=info.st_size;
+            lastGrowth=msecs();
+        }
+        if(itsSize>=size)
+            return true;
+        if(itsClosed || -1==itsFd)
+            return false;
+
+        int64_t remaining=(itsTimeout*1000)-(msecs()-lastGrowth);
+
+        if(remaining<=0)
+            return false;
+
+        struct pollfd pfd;
+
+        pfd.fd=itsFd;
+        pfd.events=POLLIN;
+
+        int rv=poll(&pfd, 1, remaining);
+
+        if(rv<0 && EINTR==errno)
+            continue;
+        if(rv<0 || (rv>0 && !readEvents()))
+            return false;
+    }
+}
+
+//
+// Events are for any file in the directory - the only one that matters is this file being closed.
+bool CFileWatcher::readEvents()
+{
+    char    buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len=read(itsFd, buffer, sizeof(buffer));
+
+    if(len<=0)
+        return EINTR==errno || EAGAIN==errno;
+
+    for(char *ptr=buffer; ptr<buffer+len; ptr+=sizeof(struct inotify_event)+((struct inotify_event *)ptr)->len)
+    {
+        const struct inotify_event *event=(const struct inotify_event *)ptr;
+
+        if(event->len && 0==strcmp(event->name, itsBaseName.constData()) && event->mask&IN_CLOSE_WRITE)
+            itsClosed=true;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <stdint.h>
+
+//
+// Waits for a file that is still being written - e.g. by dvgrab - to grow. The file's directory is
+// watched with inotify, so the file need not exist yet. Waiting ends when the file has not grown
+// for 'timeout' seconds, or when the writer closes it.
+class CFileWatcher
+{
+    public:
+
+    CFileWatcher(const QString &name, int timeout);
+    ~CFileWatcher();
+
+    //
+    // Returns true once the file is at least 'size' bytes.
+    bool    waitFor(int64_t size);
+    int64_t size() const { return itsSize; }
+
+    private:
+
+    bool    readEvents();
+
+    private:
+
+    QString    itsName;
+    QByteArray itsBaseName;
+    int        itsFd,
+               itsTimeout;
+    bool       itsClosed;
+    int64_t    itsSize;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef FORMAT_TRAITS_H
+#define FORMAT_TRAITS_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+//
+// Compile time descriptions of the two DV systems. The per-frame code - i.e. YUV plane extraction,
+// and deinterlacing - is templated on these, so that its loops have constant trip counts that the
+// compiler can unroll and vectorise. As every clip in a list has the same type, the format is
+// picked once, when the extractor is created, rather than tested for every frame.
+struct CPalFormat
+{
+    static const int  constWidth=720;
+    static const int  constHeight=576;
+    static const int  constFrameSize=144000;
+    static const int  constDifSequences=12;
+    static const bool constPal=true;
+
+    static const char * frameRate() { return "25:1"; }
+    static const char * chroma()    { return "C420paldv"; }
+};
+
+struct CNtscFormat
+{
+    static const int  constWidth=720;
+    static const int  constHeight=480;
+    static const int  constFrameSize=120000;
+    static const int  constDifSequences=10;
+    static const bool constPal=false;
+
+    static const char * frameRate() { return "30000:1001"; }
+    static const char * chroma()    { return "C420mpeg2"; }
+};
+
+#endif
@@ -30,6 +30,7 @@
 // #endif
 
 #include <string.h>
+#include <math.h>
 
 typedef char   gchar;
 typedef short  gshort;
@@ -68,6 +69,9 @@ using std::endl;
 
 // local includes
 #include "Frame.h"
+#include "FormatTraits.h"
+#include "Kernels.h"
+#include "FrameCache.h"
 // #include "preferences.h"
 
 // extern Preferences prefs;
@@ -98,7 +102,7 @@ short Frame::compmap[4096];
  
 */
 
-Frame::Frame() : playlist_position( -1 ), bytesInFrame(0)
+Frame::Frame() : playlist_position( -1 ), bytesInFrame(0), cache_key( new CFrameCacheKey )
 {
 //     memset(data, 0, 144000);
 
@@ -183,6 +187,7 @@ Frame::~Frame()
 #endif
 	for (int n = 0; n < 4; n++)
 		free(audio_buffers[n]);
+	delete cache_key;
 }
 
 
@@ -679,6 +684,133 @@ bool Frame::IsComplete(void) const
 }
 
 
+/** reconstructs a reduced size image from the DC coefficients
+
+    Each video DIF block holds one macroblock, and the first 9 bits of each of its DCT blocks
+    are the block's DC coefficient - i.e. its average value. Taking just these gives an image
+    of 1/8 the width and height of the frame (90x72 for PAL, 90x60 for NTSC) without any VLC
+    decoding or IDCT. The macroblock placement follows that of libdv (place.c).
+
+    \param rgb a buffer of at least (720/8) * (height/8) * 3 bytes
+    \return the number of bytes put into the buffer */
+
+static inline int dc_value( const unsigned char *block )
+{
+	int dc = ( block[ 0 ] << 1 ) | ( block[ 1 ] >> 7 );
+	if ( dc & 0x100 )
+		dc -= 0x200;
+	dc = 128 + dc / 2;
+	return dc < 0 ? 0 : ( dc > 255 ? 255 : dc );
+}
+
+static inline unsigned char clamp_rgb( int v )
+{
+	return v < 0 ? 0 : ( v > 255 ? 255 : v );
+}
+
+int Frame::ExtractDCRGB(void *rgb) const
+{
+	static const int super_map_vertical[ 5 ] = { 2, 6, 8, 0, 4 };
+	static const int super_map_horizontal[ 5 ] = { 2, 1, 3, 0, 4 };
+	static const int pal_column_offset[ 5 ] = { 0, 9, 18, 27, 36 };
+	static const int ntsc_column_offset[ 5 ] = { 0, 4, 9, 13, 18 };
+	static const int luma_offset[ 4 ] = { 4, 18, 32, 46 };
+	static const int width = FRAME_MAX_WIDTH / 8;
+
+	bool pal = IsPAL();
+	int seqCount = pal ? 12 : 10;
+	int height = ( pal ? 576 : 480 ) / 8;
+	int size = GetFrameSize();
+	unsigned char y[ width * FRAME_MAX_HEIGHT / 8 ];
+	unsigned char cr[ width * FRAME_MAX_HEIGHT / 8 ];
+	unsigned char cb[ width * FRAME_MAX_HEIGHT / 8 ];
+
+	memset( y, 16, sizeof( y ) );
+	memset( cr, 128, sizeof( cr ) );
+	memset( cb, 128, sizeof( cb ) );
+
+	for ( int i = 0; i < size; i += 80 )
+	{
+		const unsigned char *block = &data[ i ];
+
+		/* only video DIF blocks, the header holds the sequence and block numbers */
+		if ( ( block[ 0 ] & 0xe0 ) != 0x80 )
+			continue;
+
+		int seq = block[ 1 ] >> 4;
+		int dbn = block[ 2 ];
+
+		if ( seq >= seqCount || dbn >= 135 )
+			continue;
+
+		/* 5 macroblocks per video segment, each from a different super block */
+		int k = dbn / 5;
+		int m = dbn % 5;
+		int si = ( seq + super_map_vertical[ m ] ) % seqCount;
+		int sj = super_map_horizontal[ m ];
+		int bx, by, lw, cw, ch;
+
+		if ( pal )
+		{
+			/* 4:2:0 - 16x16 macroblocks, zig-zag of 3 rows by 9 columns */
+			int row = ( ( k / 3 ) % 2 == 0 ) ? k % 3 : 2 - k % 3;
+			bx = ( k / 3 + pal_column_offset[ sj ] ) * 2;
+			by = ( si * 3 + row ) * 2;
+			lw = 2;
+		}
+		else
+		{
+			/* 4:1:1 - 32x8 macroblocks, zig-zag of 6 rows by 5 columns */
+			int num = ( sj % 2 == 1 ) ? k + 3 : k;
+			int row = ( ( num / 6 ) % 2 == 0 ) ? num % 6 : 5 - num % 6;
+			int col = num / 6 + ntsc_column_offset[ sj ];
+
+			if ( col < 22 )
+			{
+				bx = col * 4;
+				by = si * 6 + row;
+				lw = 4;
+			}
+			else
+			{
+				/* right most column is made of 16x16 macroblocks */
+				bx = col * 4;
+				by = si * 6 + row * 2;
+				lw = 2;
+			}
+		}
+
+		cw = lw;
+		ch = 4 / lw;
+
+		for ( int b = 0; b < 4; b++ )
+			y[ ( by + b / lw ) * width + bx + b % lw ] = dc_value( block + luma_offset[ b ] );
+
+		for ( int r = 0; r < ch; r++ )
+			for ( int c = 0; c < cw; c++ )
+			{
+				cr[ ( by + r ) * width + bx + c ] = dc_value( block + 60 );
+				cb[ ( by + r ) * width + bx + c ] = dc_value( block + 70 );
+			}
+	}
+
+	unsigned char *p = ( unsigned char * ) rgb;
+
+	for ( int n = 0; n < width * height; n++ )
+	{
+		int l = 298 * ( y[ n ] - 16 ) + 128;
+		int u = cb[ n ] - 128;
+		int v = cr[ n ] - 128;
+
+		*p++ = clamp_rgb( ( l + 409 * v ) >> 8 );
+		*p++ = clamp_rgb( ( l - 100 * u - 208 * v ) >> 8 );
+		*p++ = clamp_rgb( ( l + 516 * u ) >> 8 );
+	}
+
+	return width * height * 3;
+}
+
+
 /** retrieves the audio data from the frame
  
     The DV frame contains audio data mixed in the video data blocks, 
@@ -690,9 +822,63 @@ bool Frame::IsComplete(void) const
     \param sound a pointer to a buffer that holds the audio data
     \return the number of bytes put into the buffer, or 0 if no audio data could be retrieved */
 
+/* Decoded frame cache. Copies a cached entry into 'count' buffers, of the given sizes - or, if
+   'count' is 1 and 'sizes' is NULL, into a buffer of 'capacity' bytes, returning the size of the
+   entry. Returns -1 if not cached, or the entry does not fit. */
+
+static int FetchCached( CFrameCache::Key key, int settings, uint8_t **buffers, const int *sizes, int count, int capacity = 0 )
+{
+	if ( !CFrameCache::instance || !key.isValid() )
+		return -1;
+
+	key.settings = settings;
+	QByteArray cached = CFrameCache::instance->fetch( key );
+
+	if ( cached.isNull() )
+		return -1;
+	if ( !sizes )
+	{
+		if ( cached.size() > capacity )
+			return -1;
+		memcpy( buffers[ 0 ], cached.constData(), cached.size() );
+		return cached.size();
+	}
+
+	int total = 0;
+	for ( int i = 0; i < count; i++ )
+		total += sizes[ i ];
+	if ( cached.size() != total )
+		return -1;
+
+	const char *src = cached.constData();
+	for ( int i = 0; i < count; i++ )
+	{
+		memcpy( buffers[ i ], src, sizes[ i ] );
+		src += sizes[ i ];
+	}
+	return cached.size();
+}
+
+static void StoreCached( CFrameCache::Key key, int settings, uint8_t **buffers, const int *sizes, int count )
+{
+	if ( !CFrameCache::instance || !key.isValid() || !key.keep )
+		return;
+
+	QByteArray data;
+	for ( int i = 0; i < count; i++ )
+		data.append( (const char *)buffers[ i ], sizes[ i ] );
+	key.settings = settings;
+	CFrameCache::instance->store( key, data );
+}
+
 int Frame::ExtractAudio(void *sound) const
 {
     AudioInfo info;
+	uint8_t *buffer = (uint8_t *)sound;
+	int cached = FetchCached( *cache_key, CFrameCache::Pcm, &buffer, 0L, 1, FRAME_MAX_AUDIO_SIZE );
+
+	if ( cached >= 0 )
+		return cached;
 	
 #ifdef HAVE_LIBDV
     if (GetAudioInfo(info) == true) {
@@ -700,6 +886,8 @@ int Frame::ExtractAudio(void *sound) const
 		int16_t* s = (int16_t *) sound;
 		if(!dv_decode_full_audio( decoder, data, (int16_t **)audio_buffers))
 			memset(s, 0, info.samples*info.channels*2);
+		else if (2 == info.channels)
+			Kernels::interleave( audio_buffers[0], audio_buffers[1], s, info.samples );
 		else
 
 		for (n = 0; n < info.samples; ++n)
@@ -771,14 +959,18 @@ int Frame::ExtractAudio(void *sound) const
 	}
 
 #endif
-    return info.samples * info.channels * 2;
+	int size = info.samples * info.channels * 2;
+	StoreCached( *cache_key, CFrameCache::Pcm, &buffer, &size, 1 );
+    return size;
 }
 
 #ifdef HAVE_LIBDV
 
+int Frame::preferred_quality = DV_QUALITY_BEST;
+
 void Frame::SetPreferredQuality( )
 {
-	decoder->quality = DV_QUALITY_BEST;
+	decoder->quality = preferred_quality;
 }
 
 /** retrieves the audio data from the frame
@@ -946,15 +1138,31 @@ int Frame::ExtractYUV(void *yuv)
     return 0;
 }
 
+// For callers that do not know the format in advance
 int Frame::ExtractYUV420(uint8_t *yuv, uint8_t *output[ 3 ])
 {
+	return IsPAL() ? ExtractYUV420<CPalFormat>( yuv, output ) : ExtractYUV420<CNtscFormat>( yuv, output );
+}
+
+// Templated on the DV system, so that the plane loops have constant trip counts. The frame must
+// be of format F.
+template <class F> int Frame::ExtractYUV420(uint8_t *yuv, uint8_t *output[ 3 ])
+{
+	// Frames repeated in the project come from the cache
+	const int plane = F::constWidth * F::constHeight;
+	int sizes[ 3 ] = { plane, plane / 4, plane / 4 };
+	int settings = CFrameCache::Yuv420 | ( decoder->quality << 4 );
+
+	if ( FetchCached( *cache_key, settings, output, sizes, 3 ) >= 0 )
+		return 0;
+
 #if defined(HAVE_LIBAVCODEC)
     AVFrame frame;
     int got_picture;
 
     avcodec_decode_video( &libavcodec, &frame, &got_picture, data, GetFrameSize() );
 
-    int width = GetWidth(), height = GetHeight();
+    const int width = F::constWidth, height = F::constHeight;
 
     if ( libavcodec.pix_fmt == PIX_FMT_YUV420P ) // PAL
     {
@@ -1018,44 +1226,24 @@ int Frame::ExtractYUV420(uint8_t *yuv, uint8_t *output[ 3 ])
 #else
     guchar *pixels[3];
     gint pitches[3];
-    int width = GetWidth(), height = GetHeight();
+    const int width = F::constWidth;
 
     pixels[0] = (guchar*)yuv;
-    pitches[0] = decoder->width * 2;
+    pitches[0] = width * 2;
 
     dv_decode_full_frame(decoder, data, e_dv_color_yuv, pixels, pitches);
 
-	int w2 = width/2;
-	uint8_t *y = output[0];
-	uint8_t *cb = output[1];
-	uint8_t *cr = output[2];
-	uint8_t *p = yuv;
-
-	for ( int i = 0; i < height; i += 2 ) 
-	{
-		/* process two scanlines (one from each field, interleaved) */
-		for ( int j = 0; j < w2; j++ ) 
-		{
-			/* packed YUV 422 is: Y[i] U[i] Y[i+1] V[i] */
-			*(y++) =  *(p++);
-			*(cb++) = *(p++);
-			*(y++) =  *(p++);
-			*(cr++) = *(p++);
-		}
-		/* process next two scanlines (one from each field, interleaved) */
-		for ( int j = 0; j < w2; j++ ) 
-		{
-			/* skip every second line for U and V */
-			*(y++) = *(p++);
-			p++;
-			*(y++) = *(p++);
-			p++;
-		}
-	}
+	// The plane loops are in Kernels, for each instruction set and DV system - chroma is taken from every
+	// second line
+	( F::constPal ? Kernels::yuy2ToYuv420Pal : Kernels::yuy2ToYuv420Ntsc )( yuv, output[ 0 ], output[ 1 ], output[ 2 ] );
 #endif
+	StoreCached( *cache_key, settings, output, sizes, 3 );
 	return 0;
 }
 
+template int Frame::ExtractYUV420<CPalFormat>(uint8_t *yuv, uint8_t *output[ 3 ]);
+template int Frame::ExtractYUV420<CNtscFormat>(uint8_t *yuv, uint8_t *output[ 3 ]);
+
 int Frame::ExtractPreviewYUV(void *yuv, bool deinterlace)
 {
 	ExtractYUV( yuv );
@@ -1082,7 +1270,7 @@ int Frame::ExtractPreviewYUV(void *yuv, bool deinterlace)
 */
 void Frame::Deinterlace( uint8_t *pdst, uint8_t *psrc, int stride, int height )
 {
-    register int x, y;
+    register int y;
     register uint8_t *l0, *l1, *l2, *l3;
 
     l0 = pdst;      /* target line */
@@ -1097,8 +1285,7 @@ void Frame::Deinterlace( uint8_t *pdst, uint8_t *psrc, int stride, int height )
     for (y = 1; y < height-1; ++y)
     {
         /* computes avg of: l1 + 2*l2 + l3 */
-        for ( x = 0; x < stride; ++x )
-            l0[x] = ( l1[ x ] + ( l2[ x ] << 1 ) + l3[ x ] ) >> 2;
+        Kernels::blend( l1, l2, l3, l0, stride );
 
         /* updates the line pointers */
         l1 = l2;
@@ -1194,16 +1381,16 @@ bool Frame::EncodeAudio( AudioInfo &info, int16_t **channels )
 
 AudioResample::AudioResample( int rate ) : output_rate( rate ) 
 {
-	input = new int16_t[ 20480 ];
-	output = new int16_t[ 20480 ];
+	input = new int16_t[ max_samples * max_channels ];
+	output = new int16_t[ max_output ];
 }
 
 /** Destructor for the resampler.
 */
 
 AudioResample::~AudioResample() {
-	delete input;
-	delete output;
+	delete [] input;
+	delete [] output;
 }
 
 /** Frame handler.
@@ -1233,8 +1420,10 @@ void AudioResample::Resample( Frame &frame )
 		}
 		else 
 		{
-			memcpy( output, input, info.samples * 4 );
-			size = info.samples * 4;
+			// Nothing carried over from a clip at another rate may leak into the next one
+			Reset( );
+			size = info.samples * info.channels * 2;
+			memcpy( output, input, size );
 		}
 	}
 	else 
@@ -1267,6 +1456,8 @@ void FastAudioResample::Resample( int16_t *input, int input_rate, int channels,
 {
 	float ratio = (float)output_rate / (float)input_rate;
 	size = (int)( (float)samples * ratio );
+	if ( size * channels > max_output )
+		size = max_output / channels;
 
 	int rounding = 1 << 15;
 	unsigned int xfactor = ( samples << 16 ) / size;
@@ -1282,3 +1473,149 @@ void FastAudioResample::Resample( int16_t *input, int input_rate, int channels,
 	}
 
 }
+
+/** Constructor for the polyphase resampler.
+*/
+
+PolyphaseAudioResample::PolyphaseAudioResample( int output_rate ) :
+	AudioResample( output_rate ), input_rate( 0 ), up( 1 ), down( 1 ), filters( NULL ), buffered( taps / 2 - 1 ), position( 0 )
+{
+	for ( int c = 0; c < max_channels; c ++ )
+	{
+		history[ c ] = new float[ taps + max_samples ];
+		memset( history[ c ], 0, sizeof( float ) * buffered );
+	}
+}
+
+/** Drop the filter history, so that the next frame starts afresh.
+*/
+
+void PolyphaseAudioResample::Reset( )
+{
+	buffered = taps / 2 - 1;
+	position = 0;
+	for ( int c = 0; c < max_channels; c ++ )
+		memset( history[ c ], 0, sizeof( float ) * buffered );
+}
+
+/** Destructor for the polyphase resampler.
+*/
+
+PolyphaseAudioResample::~PolyphaseAudioResample()
+{
+	delete [] filters;
+	for ( int c = 0; c < max_channels; c ++ )
+		delete [] history[ c ];
+}
+
+static double BesselI0( double x )
+{
+	double sum = 1.0, term = 1.0;
+
+	for ( int k = 1; k < 50 && term > sum * 1e-12; k ++ )
+	{
+		term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+		sum += term;
+	}
+	return sum;
+}
+
+static int Gcd( int a, int b )
+{
+	while ( b )
+	{
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/** Build the filter bank for the given input rate.
+ 
+    Phase p holds the taps for an output sample p/up of an input sample after the start of the
+    window centre. The cutoff is just below the lower of the two Nyquist frequencies, and each phase
+    is normalised to unity gain.
+ 
+    \param rate The input sampling frequency.
+*/
+
+void PolyphaseAudioResample::CreateFilters( int rate )
+{
+	static const double beta = 8.0;
+
+	int g = Gcd( output_rate, rate );
+	int old_up = up;
+
+	up = output_rate / g;
+	down = rate / g;
+	position = ( position / old_up ) * up;
+	input_rate = rate;
+
+	delete [] filters;
+	filters = new float[ up * taps ];
+
+	double cutoff = 0.475 * ( up < down ? ( double ) up / down : 1.0 );
+	double half = taps / 2;
+	double norm = BesselI0( beta );
+
+	for ( int p = 0; p < up; p ++ )
+	{
+		float *h = filters + p * taps;
+		double sum = 0.0;
+
+		for ( int k = 0; k < taps; k ++ )
+		{
+			double d = ( k - ( half - 1 ) ) - ( double ) p / up;
+			double x = d / half;
+			double w = x > -1.0 && x < 1.0 ? BesselI0( beta * sqrt( 1.0 - x * x ) ) / norm : 0.0;
+			double v = 0.0 == d ? 2.0 * cutoff : sin( 2.0 * M_PI * cutoff * d ) / ( M_PI * d );
+
+			h[ k ] = v * w;
+			sum += h[ k ];
+		}
+		for ( int k = 0; k < taps; k ++ )
+			h[ k ] /= sum;
+	}
+}
+
+/** Windowed sinc resampler.
+ 
+    Input is appended to the per channel history, and as many output samples are produced as the
+    history allows - the remainder is kept for the next frame.
+*/
+
+void PolyphaseAudioResample::Resample( int16_t *input, int rate, int channels, int samples )
+{
+	if ( rate != input_rate )
+		CreateFilters( rate );
+
+	int stride = channels;
+	int used = channels > max_channels ? max_channels : channels;
+	int o = 0;
+
+	for ( int s = 0; s < samples; s ++ )
+		for ( int c = 0; c < used; c ++ )
+			history[ c ][ buffered + s ] = input[ s * stride + c ];
+	buffered += samples;
+
+	for ( ; ( position / up ) + taps <= buffered && ( o + 1 ) * used <= max_output; position += down, o ++ )
+	{
+		int j = position / up;
+		const float *h = filters + ( position % up ) * taps;
+
+		for ( int c = 0; c < used; c ++ )
+		{
+			float v = Kernels::dot( history[ c ] + j, h, taps );
+			output[ o * used + c ] = v >= 32767.0f ? 32767 : v <= -32768.0f ? -32768 : ( int16_t ) lrintf( v );
+		}
+	}
+	size = o * used * 2;
+
+	int consumed = position / up;
+
+	for ( int c = 0; c < used; c ++ )
+		memmove( history[ c ], history[ c ] + consumed, sizeof( float ) * ( buffered - consumed ) );
+	buffered -= consumed;
+	position -= ( int64_t ) consumed * up;
+}
@@ -28,6 +28,8 @@
 #include <string>
 using std::string;
 
+struct CFrameCacheKey;
+
 #ifdef HAVE_LIBDV
 #include <libdv/dv.h>
 #include <libdv/dv_types.h>
@@ -41,6 +43,8 @@ extern "C" {
 
 #define FRAME_MAX_WIDTH 720
 #define FRAME_MAX_HEIGHT 576
+/// 1944 samples, of up to 4 channels of 16 bits
+#define FRAME_MAX_AUDIO_SIZE (1944*4*2)
 
 typedef struct Pack
 {
@@ -96,6 +100,8 @@ public:
     unsigned char *data; // [144000]; CPD Set in CClip.cpp -> and dont want to memcpy!
     /// the number of bytes written to the frame
     int bytesInFrame;
+    /// where 'data' came from, so that decoded output may be cached - see CFrameCache
+    CFrameCacheKey *cache_key;
 	
 #if defined(HAVE_LIBAVCODEC)
     AVCodecContext libavcodec;
@@ -124,7 +130,9 @@ public:
     bool IsNewRecording(void) const;
     bool IsComplete(void) const;
     int ExtractAudio(void *sound) const;
+    int ExtractDCRGB(void *rgb) const;
 #ifdef HAVE_LIBDV
+	static int preferred_quality; // Set from CClipList::quality
 	void SetPreferredQuality( );
     int ExtractAudio(int16_t **channels) const;
     void ExtractHeader(void);
@@ -132,6 +140,7 @@ public:
     int ExtractPreviewRGB(void *rgb, bool deinterlace);
     int ExtractYUV(void *yuv);
 	int ExtractYUV420(uint8_t *yuv, uint8_t *output[ 3 ]);
+	template <class F> int ExtractYUV420(uint8_t *yuv, uint8_t *output[ 3 ]); // F is from FormatTraits.h
     int ExtractPreviewYUV(void *yuv, bool deinterlace);
     void Deinterlace( uint8_t *pdst, uint8_t *psrc, int stride, int height );
     bool IsWide(void) const;
@@ -161,6 +170,11 @@ private:
 
 class AudioResample {
 	protected:
+		// DV has at most 1944 samples of 4 channels a frame, and the lowest rate is 32kHz. Resampling
+		// to the highest --rate gives 6 times as many samples - plus the polyphase filter history.
+		enum { max_samples = 1944 + 64, max_channels = 4, max_ratio = 192000 / 32000,
+		       max_output = max_samples * max_ratio * max_channels };
+
 		int output_rate;
 		int16_t *input;
 
@@ -168,6 +182,7 @@ class AudioResample {
 		AudioResample( int output_rate );
 		virtual ~AudioResample();
 		virtual void Resample( int16_t *samples, int input_rate, int channels, int samples_this_frame ) { };
+		virtual void Reset( ) { };
 		void Resample( Frame &frame );
 		void SetOutputFrequency( int output_rate ) { this->output_rate = output_rate; }
 		int GetOutputFrequency( ) { return this->output_rate; }
@@ -184,4 +199,32 @@ class FastAudioResample : public AudioResample {
 		void Resample( int16_t *samples, int input_rate, int channels, int samples_this_frame );
 };
 
+/** Windowed sinc (Kaiser) polyphase resampler.
+ 
+    The filter bank has one set of taps for each of the L phases, where L/M is the reduced ratio of
+    the output and input rates. Unconsumed input (the filter history) is carried across frames, so
+    there are no discontinuities at frame boundaries.
+*/
+
+class PolyphaseAudioResample : public AudioResample {
+	private:
+		enum { taps = 32 };
+
+		int input_rate;
+		int up;
+		int down;
+		float *filters;
+		float *history[ max_channels ];
+		int buffered;
+		int64_t position;
+
+		void CreateFilters( int input_rate );
+
+	public:
+		PolyphaseAudioResample( int output_rate );
+		virtual ~PolyphaseAudioResample();
+		void Resample( int16_t *samples, int input_rate, int channels, int samples_this_frame );
+		void Reset( );
+};
+
 #endif
@@ -0,0 +1,195 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "FrameCache.h"
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <unistd.h>
+#include <stdio.h>
+
+CFrameCache * CFrameCache::instance=0L;
+QString       CFrameCache::sharedDir;
+
+CFrameCache::CFrameCache(int64_t budget, const QString &dir, bool shared)
+           : itsHead(0L),
+             itsTail(0L),
+             itsBudget(budget),
+             itsSize(0),
+             itsDir(dir),
+             itsShared(shared && !dir.isEmpty())
+{
+}
+
+CFrameCache::~CFrameCache()
+{
+    if(!itsShared)
+    {
+        QSet<Key>::ConstIterator it(itsSpilled.begin()),
+                                 end(itsSpilled.end());
+
+        for(; it!=end; ++it)
+            QFile::remove(path(*it));
+    }
+
+    while(itsHead)
+    {
+        Entry *e=itsHead;
+
+        if(itsShared)
+            spill(e);
+        itsHead=itsHead->next;
+        delete e;
+    }
+}
+
+//
+// Returns a null QByteArray if 'key' is not cached. As QByteArray is implicitly shared, the data
+// remains valid even if another thread causes the entry to be evicted.
+QByteArray CFrameCache::fetch(const Key &key)
+{
+    QMutexLocker locker(&itsMutex);
+
+    if(itsEntries.contains(key))
+    {
+        Entry *e=itsEntries[key];
+
+        unlink(e);
+        pushFront(e);
+        return e->data;
+    }
+
+    if(itsSpilled.contains(key) || (itsShared && QFile::exists(path(key))))
+    {
+        QFile file(path(key));
+
+        if(file.open(QIODevice::ReadOnly))
+        {
+            Entry *e=new Entry;
+
+            e->key=key;
+            e->data=file.readAll();
+            file.close();
+            if(!itsShared)
+                file.remove();
+            itsSpilled.remove(key);
+            itsEntries.insert(key, e);
+            pushFront(e);
+            itsSize+=e->data.size();
+            evict();
+            return e->data;
+        }
+        itsSpilled.remove(key);
+    }
+
+    return QByteArray();
+}
+
+void CFrameCache::store(const Key &key, const QByteArray &data)
+{
+    QMutexLocker locker(&itsMutex);
+
+    if(data.size()>itsBudget || itsEntries.contains(key))
+        return;
+
+    Entry *e=new Entry;
+
+    e->key=key;
+    e->data=data;
+    itsEntries.insert(key, e);
+    pushFront(e);
+    itsSize+=data.size();
+    evict();
+}
+
+void CFrameCache::unlink(Entry *e)
+{
+    if(e->prev)
+        e->prev->next=e->next;
+    else
+        itsHead=e->next;
+    if(e->next)
+        e->next->prev=e->prev;
+    else
+        itsTail=e->prev;
+}
+
+void CFrameCache::pushFront(Entry *e)
+{
+    e->prev=0L;
+    e->next=itsHead;
+    if(itsHead)
+        itsHead->prev=e;
+    itsHead=e;
+    if(!itsTail)
+        itsTail=e;
+}
+
+//
+// Drop the least recently used entries until within budget - writing them to the cache directory,
+// if there is one.
+void CFrameCache::evict()
+{
+    while(itsSize>itsBudget && itsTail)
+    {
+        Entry *e=itsTail;
+
+        if(!itsDir.isEmpty() && spill(e))
+            itsSpilled.insert(e->key);
+
+        unlink(e);
+        itsEntries.remove(e->key);
+        itsSize-=e->data.size();
+        delete e;
+    }
+}
+
+//
+// Write an entry to the cache directory. Other processes may read a shared directory at any time, so
+// entries are written to a temporary file and then renamed into place.
+bool CFrameCache::spill(const Entry *e)
+{
+    QString dest(path(e->key)),
+            name(itsShared ? dest+QString::asprintf(".%d", (int)getpid()) : dest);
+
+    if(itsShared && QFile::exists(dest))
+        return true;
+
+    QFile file(name);
+
+    if(file.open(QIODevice::WriteOnly) && e->data.size()==file.write(e->data))
+    {
+        file.close();
+        if(!itsShared || 0==rename(QFile::encodeName(name).constData(), QFile::encodeName(dest).constData()))
+            return true;
+    }
+    file.remove();
+    return false;
+}
+
+QString CFrameCache::path(const Key &key) const
+{
+    QString id=QString::asprintf("%llx-%llx-%llx-%llx-%llx-%x", (unsigned long long)key.device,
+                                 (unsigned long long)key.inode, (unsigned long long)key.size,
+                                 (unsigned long long)key.mtime, (unsigned long long)key.offset, key.settings);
+
+    return itsShared
+            ? itsDir+"/catdv-"+id
+            : itsDir+QString::asprintf("/catdv-%d-", (int)getpid())+id;
+}
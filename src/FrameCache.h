@@ -0,0 +1,124 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QMutex>
+#include <stdint.h>
+
+//
+// Where a frame came from, and how it was decoded. This is outside of CFrameCache so that Frame can
+// hold one without including Qt.
+struct CFrameCacheKey
+{
+    CFrameCacheKey() : device(0), inode(0), size(0), mtime(0), offset(-1), settings(0), keep(false) { }
+
+    bool isValid() const { return offset>=0; }
+    bool operator==(const CFrameCacheKey &o) const
+        { return device==o.device && inode==o.inode && size==o.size && mtime==o.mtime && offset==o.offset &&
+                 settings==o.settings; }
+
+    uint64_t device,
+             inode;
+    int64_t  size,     // The file's size and modification time (ns), so that a file rewritten in place,
+             mtime,    // or a reused inode, does not match frames cached from the old one
+             offset;
+    int      settings; // Type, and decode quality - set by Frame
+    bool     keep;     // A later clip reads this frame again, so it is worth storing
+};
+
+//
+// LRU cache of decoded frames - YUV 4:2:0 planes, and PCM audio - so that a range of DV that is
+// used more than once in a project is only decoded once. Entries are keyed on where the DV came
+// from (device, inode, size, mtime and offset), and how it was decoded. When a directory is given,
+// entries pushed out of memory are written there, rather than dropped.
+class CFrameCache
+{
+    public:
+
+    enum Type
+    {
+        Yuv420,
+        Pcm
+    };
+
+    typedef CFrameCacheKey Key;
+
+    //
+    // NULL unless --cache is used
+    static CFrameCache *instance;
+    //
+    // Set by a --serve server. Its jobs that use --cache without --cache-dir share this directory, so
+    // that a frame decoded by one job is not decoded again by the next.
+    static QString     sharedDir;
+
+    //
+    // The entries of a 'shared' directory are used by any process, and are left there - any still in
+    // memory are written out when the cache is deleted.
+    CFrameCache(int64_t budget, const QString &dir, bool shared=false);
+    ~CFrameCache();
+
+    QByteArray fetch(const Key &key);
+    void       store(const Key &key, const QByteArray &data);
+
+    private:
+
+    struct Entry
+    {
+        Key        key;
+        QByteArray data;
+        Entry      *prev,
+                   *next;
+    };
+
+    void       unlink(Entry *e);
+    void       pushFront(Entry *e);
+    void       evict();
+    bool       spill(const Entry *e);
+    QString    path(const Key &key) const;
+
+    private:
+
+    QMutex              itsMutex;
+    QHash<Key, Entry *> itsEntries;
+    QSet<Key>           itsSpilled;
+    Entry               *itsHead,
+                        *itsTail;
+    int64_t             itsBudget,
+                        itsSize;
+    QString             itsDir;
+    bool                itsShared;
+};
+
+inline uint qHash(const CFrameCache::Key &key)
+{
+    uint64_t v=(key.device*0x9E3779B97F4A7C15ULL)^(key.inode*0xC2B2AE3D27D4EB4FULL)^
+               ((uint64_t)key.offset*0x165667B19E3779F9ULL)^(uint64_t)key.settings^
+               ((uint64_t)key.size*0x27D4EB2F165667C5ULL)^(uint64_t)key.mtime;
+
+    return (uint)(v^(v>>32));
+}
+
+#endif
@@ -0,0 +1,604 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Kernels.h"
+#include "Convert.h"
+#include "FormatTraits.h"
+#include <string.h>
+
+#ifdef HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Kernels
+{
+
+static const char * constNames[NumLevels]={ "c", "sse2", "ssse3", "avx2", "avx512" };
+
+//
+// Portable versions
+static void yuy2ToPlanesC(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr, int width)
+{
+    for(int x=0; x<width; x+=2, src+=4)
+    {
+        *(y++)=src[0];
+        *(cb++)=src[1];
+        *(y++)=src[2];
+        *(cr++)=src[3];
+    }
+}
+
+static void yuy2ToLumaC(const uint8_t *src, uint8_t *y, int width)
+{
+    for(int x=0; x<width; x+=2, src+=4)
+    {
+        *(y++)=src[0];
+        *(y++)=src[2];
+    }
+}
+
+template<class F> static void yuy2ToYuv420C(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    for(int i=0; i<F::constHeight; i+=2)
+    {
+        yuy2ToPlanesC(src, y, cb, cr, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+        cb+=F::constWidth/2;
+        cr+=F::constWidth/2;
+        yuy2ToLumaC(src, y, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+    }
+}
+
+//
+// 8 bit fixed point BT.601 - e.g. 77 is 0.299*256. A chroma of 256 wraps to 0, as it always has.
+static void rgbToYuvC(const unsigned char *rgb, uint8_t *y, uint8_t *cb, uint8_t *cr, int width)
+{
+    for(int x=0; x<width; x+=2, rgb+=6)
+    {
+        int r1=rgb[0]+rgb[3],
+            g1=rgb[1]+rgb[4],
+            b1=rgb[2]+rgb[5];
+
+        *(y++)=((77*rgb[0])+(150*rgb[1])+(29*rgb[2])+128)>>8;
+        *(y++)=((77*rgb[3])+(150*rgb[4])+(29*rgb[5])+128)>>8;
+        *(cb++)=((-(43*r1)-(85*g1)+(128*b1)+511)>>9)+128;
+        *(cr++)=(((128*r1)-(107*g1)-(21*b1)+511)>>9)+128;
+    }
+}
+
+static void blendC(const uint8_t *l1, const uint8_t *l2, const uint8_t *l3, uint8_t *dst, int bytes)
+{
+    for(int x=0; x<bytes; ++x)
+        dst[x]=(l1[x]+(l2[x]<<1)+l3[x])>>2;
+}
+
+static void interleaveC(const int16_t *left, const int16_t *right, int16_t *dst, int samples)
+{
+    for(int n=0; n<samples; ++n)
+    {
+        *(dst++)=left[n];
+        *(dst++)=right[n];
+    }
+}
+
+static float dotC(const float *a, const float *b, int n)
+{
+    float sum=0.0f;
+
+    for(int i=0; i<n; ++i)
+        sum+=a[i]*b[i];
+    return sum;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+//
+// SSE2 - every x86_64 CPU has this
+__attribute__((target("sse2")))
+static void yuy2ToPlanesSse2(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr, int width)
+{
+    const __m128i lowBytes=_mm_set1_epi16(0x00FF);
+    int           x=0;
+
+    for(; x+16<=width; x+=16, src+=32, y+=16, cb+=8, cr+=8)
+    {
+        __m128i in0=_mm_loadu_si128((const __m128i *)src),
+                in1=_mm_loadu_si128((const __m128i *)(src+16)),
+                chroma=_mm_packus_epi16(_mm_srli_epi16(in0, 8), _mm_srli_epi16(in1, 8)),
+                uv=_mm_packus_epi16(_mm_and_si128(chroma, lowBytes), _mm_srli_epi16(chroma, 8));
+
+        _mm_storeu_si128((__m128i *)y, _mm_packus_epi16(_mm_and_si128(in0, lowBytes), _mm_and_si128(in1, lowBytes)));
+        _mm_storel_epi64((__m128i *)cb, uv);
+        _mm_storel_epi64((__m128i *)cr, _mm_srli_si128(uv, 8));
+    }
+
+    yuy2ToPlanesC(src, y, cb, cr, width-x);
+}
+
+__attribute__((target("sse2")))
+static void yuy2ToLumaSse2(const uint8_t *src, uint8_t *y, int width)
+{
+    const __m128i lowBytes=_mm_set1_epi16(0x00FF);
+    int           x=0;
+
+    for(; x+16<=width; x+=16, src+=32, y+=16)
+        _mm_storeu_si128((__m128i *)y, _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128((const __m128i *)src), lowBytes),
+                                                        _mm_and_si128(_mm_loadu_si128((const __m128i *)(src+16)), lowBytes)));
+
+    yuy2ToLumaC(src, y, width-x);
+}
+
+template<class F> __attribute__((target("sse2")))
+static void yuy2ToYuv420Sse2(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    for(int i=0; i<F::constHeight; i+=2)
+    {
+        yuy2ToPlanesSse2(src, y, cb, cr, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+        cb+=F::constWidth/2;
+        cr+=F::constWidth/2;
+        yuy2ToLumaSse2(src, y, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+    }
+}
+
+__attribute__((target("sse2")))
+static inline __m128i blend8(__m128i a, __m128i b, __m128i c)
+{
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, c), _mm_slli_epi16(b, 1)), 2);
+}
+
+__attribute__((target("sse2")))
+static void blendSse2(const uint8_t *l1, const uint8_t *l2, const uint8_t *l3, uint8_t *dst, int bytes)
+{
+    const __m128i zero=_mm_setzero_si128();
+    int           x=0;
+
+    for(; x+16<=bytes; x+=16)
+    {
+        __m128i a=_mm_loadu_si128((const __m128i *)(l1+x)),
+                b=_mm_loadu_si128((const __m128i *)(l2+x)),
+                c=_mm_loadu_si128((const __m128i *)(l3+x));
+
+        _mm_storeu_si128((__m128i *)(dst+x),
+                         _mm_packus_epi16(blend8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+                                          blend8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero))));
+    }
+
+    blendC(l1+x, l2+x, l3+x, dst+x, bytes-x);
+}
+
+__attribute__((target("sse2")))
+static void interleaveSse2(const int16_t *left, const int16_t *right, int16_t *dst, int samples)
+{
+    int n=0;
+
+    for(; n+8<=samples; n+=8, dst+=16)
+    {
+        __m128i l=_mm_loadu_si128((const __m128i *)(left+n)),
+                r=_mm_loadu_si128((const __m128i *)(right+n));
+
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i *)(dst+8), _mm_unpackhi_epi16(l, r));
+    }
+
+    interleaveC(left+n, right+n, dst, samples-n);
+}
+
+__attribute__((target("sse2")))
+static float dotSse2(const float *a, const float *b, int n)
+{
+    __m128 sum=_mm_setzero_ps();
+    int    i=0;
+
+    for(; i+4<=n; i+=4)
+        sum=_mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+
+    sum=_mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum=_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum)+dotC(a+i, b+i, n-i);
+}
+
+//
+// SSSE3. Each component of 8 pixels is shuffled into 16 bit lanes - pixels 0 to 4 from the 1st load, and
+// 5 to 7 from the 2nd. Luma fits in unsigned 16 bits, chroma is summed as pairs in 32 bits.
+__attribute__((target("ssse3")))
+static void rgbToYuvSsse3(const unsigned char *rgb, uint8_t *y, uint8_t *cb, uint8_t *cr, int width)
+{
+    const __m128i rLo=_mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, -1, -1, -1, -1, -1, -1),
+                  rHi=_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 7, -1, 10, -1, 13, -1),
+                  gLo=_mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1),
+                  gHi=_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, -1, 11, -1, 14, -1),
+                  bLo=_mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1),
+                  bHi=_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 9, -1, 12, -1, 15, -1),
+                  zero=_mm_setzero_si128(),
+                  ones=_mm_set1_epi16(1),
+                  lowBytes=_mm_set1_epi16(0x00FF),
+                  cbRg=_mm_setr_epi16(-43, -85, -43, -85, -43, -85, -43, -85),
+                  cbB=_mm_setr_epi16(128, 511, 128, 511, 128, 511, 128, 511),
+                  crRg=_mm_setr_epi16(128, -107, 128, -107, 128, -107, 128, -107),
+                  crB=_mm_setr_epi16(-21, 511, -21, 511, -21, 511, -21, 511),
+                  offset=_mm_set1_epi32(128);
+    int           x=0;
+
+    for(; x+8<=width; x+=8, rgb+=24, y+=8, cb+=4, cr+=4)
+    {
+        __m128i lo=_mm_loadu_si128((const __m128i *)rgb),
+                hi=_mm_loadu_si128((const __m128i *)(rgb+8)),
+                r=_mm_or_si128(_mm_shuffle_epi8(lo, rLo), _mm_shuffle_epi8(hi, rHi)),
+                g=_mm_or_si128(_mm_shuffle_epi8(lo, gLo), _mm_shuffle_epi8(hi, gHi)),
+                b=_mm_or_si128(_mm_shuffle_epi8(lo, bLo), _mm_shuffle_epi8(hi, bHi)),
+                luma=_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150))),
+                                                  _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(29)), _mm_set1_epi16(128))), 8),
+                rg=_mm_packs_epi32(_mm_madd_epi16(r, ones), _mm_madd_epi16(g, ones)),
+                rgPairs=_mm_unpacklo_epi16(rg, _mm_srli_si128(rg, 8)),
+                bPairs=_mm_unpacklo_epi16(_mm_packs_epi32(_mm_madd_epi16(b, ones), zero), ones),
+                cbs=_mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rgPairs, cbRg), _mm_madd_epi16(bPairs, cbB)), 9), offset),
+                crs=_mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rgPairs, crRg), _mm_madd_epi16(bPairs, crB)), 9), offset),
+                chroma=_mm_packus_epi16(_mm_and_si128(_mm_packs_epi32(cbs, crs), lowBytes), zero);
+        int32_t cb4=_mm_cvtsi128_si32(chroma),
+                cr4=_mm_cvtsi128_si32(_mm_srli_si128(chroma, 4));
+
+        _mm_storel_epi64((__m128i *)y, _mm_packus_epi16(luma, zero));
+        memcpy(cb, &cb4, 4);
+        memcpy(cr, &cr4, 4);
+    }
+
+    rgbToYuvC(rgb, y, cb, cr, width-x);
+}
+
+//
+// AVX2. The 256 bit pack and unpack instructions work on each 128 bit half, so results that cross
+// halves are put back in order with a permute.
+__attribute__((target("avx2")))
+static void yuy2ToPlanesAvx2(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr, int width)
+{
+    const __m256i lowBytes=_mm256_set1_epi16(0x00FF);
+    int           x=0;
+
+    for(; x+32<=width; x+=32, src+=64, y+=32, cb+=16, cr+=16)
+    {
+        __m256i in0=_mm256_loadu_si256((const __m256i *)src),
+                in1=_mm256_loadu_si256((const __m256i *)(src+32)),
+                luma=_mm256_packus_epi16(_mm256_and_si256(in0, lowBytes), _mm256_and_si256(in1, lowBytes)),
+                chroma=_mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(in0, 8), _mm256_srli_epi16(in1, 8)), 0xD8),
+                uv=_mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(chroma, lowBytes), _mm256_srli_epi16(chroma, 8)), 0xD8);
+
+        _mm256_storeu_si256((__m256i *)y, _mm256_permute4x64_epi64(luma, 0xD8));
+        _mm_storeu_si128((__m128i *)cb, _mm256_castsi256_si128(uv));
+        _mm_storeu_si128((__m128i *)cr, _mm256_extracti128_si256(uv, 1));
+    }
+
+    yuy2ToPlanesSse2(src, y, cb, cr, width-x);
+}
+
+__attribute__((target("avx2")))
+static void yuy2ToLumaAvx2(const uint8_t *src, uint8_t *y, int width)
+{
+    const __m256i lowBytes=_mm256_set1_epi16(0x00FF);
+    int           x=0;
+
+    for(; x+32<=width; x+=32, src+=64, y+=32)
+    {
+        __m256i luma=_mm256_packus_epi16(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)src), lowBytes),
+                                         _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src+32)), lowBytes));
+
+        _mm256_storeu_si256((__m256i *)y, _mm256_permute4x64_epi64(luma, 0xD8));
+    }
+
+    yuy2ToLumaSse2(src, y, width-x);
+}
+
+template<class F> __attribute__((target("avx2")))
+static void yuy2ToYuv420Avx2(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    for(int i=0; i<F::constHeight; i+=2)
+    {
+        yuy2ToPlanesAvx2(src, y, cb, cr, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+        cb+=F::constWidth/2;
+        cr+=F::constWidth/2;
+        yuy2ToLumaAvx2(src, y, F::constWidth);
+        src+=F::constWidth*2;
+        y+=F::constWidth;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend16(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(a, c), _mm256_slli_epi16(b, 1)), 2);
+}
+
+__attribute__((target("avx2")))
+static void blendAvx2(const uint8_t *l1, const uint8_t *l2, const uint8_t *l3, uint8_t *dst, int bytes)
+{
+    const __m256i zero=_mm256_setzero_si256();
+    int           x=0;
+
+    // Unpacking and then packing within each half leaves the bytes in their original order
+    for(; x+32<=bytes; x+=32)
+    {
+        __m256i a=_mm256_loadu_si256((const __m256i *)(l1+x)),
+                b=_mm256_loadu_si256((const __m256i *)(l2+x)),
+                c=_mm256_loadu_si256((const __m256i *)(l3+x));
+
+        _mm256_storeu_si256((__m256i *)(dst+x),
+                            _mm256_packus_epi16(blend16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero)),
+                                                blend16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero))));
+    }
+
+    blendSse2(l1+x, l2+x, l3+x, dst+x, bytes-x);
+}
+
+__attribute__((target("avx2")))
+static void interleaveAvx2(const int16_t *left, const int16_t *right, int16_t *dst, int samples)
+{
+    int n=0;
+
+    for(; n+16<=samples; n+=16, dst+=32)
+    {
+        __m256i l=_mm256_loadu_si256((const __m256i *)(left+n)),
+                r=_mm256_loadu_si256((const __m256i *)(right+n)),
+                lo=_mm256_unpacklo_epi16(l, r),
+                hi=_mm256_unpackhi_epi16(l, r);
+
+        _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst+16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    interleaveSse2(left+n, right+n, dst, samples-n);
+}
+
+//
+// No FMA, so that each product is rounded as in the other versions - only the order of the sum differs.
+__attribute__((target("avx2")))
+static float dotAvx2(const float *a, const float *b, int n)
+{
+    __m256 sum=_mm256_setzero_ps();
+    int    i=0;
+
+    for(; i+8<=n; i+=8)
+        sum=_mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i)));
+
+    __m128 half=_mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+
+    half=_mm_add_ps(half, _mm_movehl_ps(half, half));
+    half=_mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half)+dotC(a+i, b+i, n-i);
+}
+
+//
+// AVX-512 - F and BW
+__attribute__((target("avx512f,avx512bw")))
+static void blendAvx512(const uint8_t *l1, const uint8_t *l2, const uint8_t *l3, uint8_t *dst, int bytes)
+{
+    int x=0;
+
+    for(; x+32<=bytes; x+=32)
+    {
+        __m512i a=_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(l1+x))),
+                b=_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(l2+x))),
+                c=_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(l3+x)));
+
+        _mm256_storeu_si256((__m256i *)(dst+x),
+                            _mm512_cvtepi16_epi8(_mm512_srli_epi16(_mm512_add_epi16(_mm512_add_epi16(a, c), _mm512_slli_epi16(b, 1)), 2)));
+    }
+
+    blendAvx2(l1+x, l2+x, l3+x, dst+x, bytes-x);
+}
+
+__attribute__((target("avx512f")))
+static float dotAvx512(const float *a, const float *b, int n)
+{
+    __m512 sum=_mm512_setzero_ps();
+    int    i=0;
+
+    for(; i+16<=n; i+=16)
+        sum=_mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(a+i), _mm512_loadu_ps(b+i)));
+
+    return _mm512_reduce_add_ps(sum)+dotAvx2(a+i, b+i, n-i);
+}
+
+#endif
+
+RgbToBgra    rgbToBgra=Convert::rgbToBgraC;
+RgbToBgra    rgbToGray=Convert::rgbToGrayC;
+Yuy2ToYuv420 yuy2ToYuv420Pal=yuy2ToYuv420C<CPalFormat>;
+Yuy2ToYuv420 yuy2ToYuv420Ntsc=yuy2ToYuv420C<CNtscFormat>;
+RgbToYuv     rgbToYuv=rgbToYuvC;
+Blend        blend=blendC;
+Interleave   interleave=interleaveC;
+Dot          dot=dotC;
+
+template<class T> struct Version
+{
+    Level level;
+    T     fn;
+};
+
+//
+// What init() chose, for list()
+struct Binding
+{
+    const char *name;
+    Level      used;
+    unsigned   available;
+};
+
+static const int constMaxKernels=16;
+static Binding   bindings[constMaxKernels];
+static int       numBindings=0;
+static Level     cpuLevel=C,
+                 maxLevel=C;
+
+//
+// Versions are listed from the lowest level
+template<class T> static void bind(const char *name, T &kernel, const Version<T> *versions, int count, Level max)
+{
+    Binding &b=bindings[numBindings++];
+
+    b.name=name;
+    b.used=C;
+    b.available=0;
+    for(int i=0; i<count; ++i)
+    {
+        b.available|=1<<versions[i].level;
+        if(versions[i].level<=max)
+        {
+            kernel=versions[i].fn;
+            b.used=versions[i].level;
+        }
+    }
+}
+
+Level detect()
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return Avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return Avx2;
+    if(__builtin_cpu_supports("ssse3"))
+        return Ssse3;
+    if(__builtin_cpu_supports("sse2"))
+        return Sse2;
+#endif
+    return C;
+}
+
+const char * name(Level level)
+{
+    return level>=C && level<NumLevels ? constNames[level] : "?";
+}
+
+bool init(const char *cpu)
+{
+    cpuLevel=detect();
+    maxLevel=cpuLevel;
+
+    if(cpu)
+    {
+        int l=C;
+
+        for(; l<NumLevels && 0!=strcmp(cpu, constNames[l]); ++l)
+            ;
+        if(l>=NumLevels || l>cpuLevel)
+            return false;
+        maxLevel=(Level)l;
+    }
+
+    static const Version<RgbToBgra> rgbToBgraVersions[]=
+    {
+        { C, Convert::rgbToBgraC },
+#ifdef HAVE_X86_KERNELS
+        { Ssse3, Convert::rgbToBgraSsse3 },
+#endif
+    };
+    static const Version<RgbToBgra> rgbToGrayVersions[]=
+    {
+        { C, Convert::rgbToGrayC },
+#ifdef HAVE_X86_KERNELS
+        { Ssse3, Convert::rgbToGraySsse3 },
+#endif
+    };
+    static const Version<Yuy2ToYuv420> yuy2ToYuv420PalVersions[]=
+    {
+        { C, yuy2ToYuv420C<CPalFormat> },
+#ifdef HAVE_X86_KERNELS
+        { Sse2, yuy2ToYuv420Sse2<CPalFormat> },
+        { Avx2, yuy2ToYuv420Avx2<CPalFormat> },
+#endif
+    };
+    static const Version<Yuy2ToYuv420> yuy2ToYuv420NtscVersions[]=
+    {
+        { C, yuy2ToYuv420C<CNtscFormat> },
+#ifdef HAVE_X86_KERNELS
+        { Sse2, yuy2ToYuv420Sse2<CNtscFormat> },
+        { Avx2, yuy2ToYuv420Avx2<CNtscFormat> },
+#endif
+    };
+    static const Version<RgbToYuv> rgbToYuvVersions[]=
+    {
+        { C, rgbToYuvC },
+#ifdef HAVE_X86_KERNELS
+        { Ssse3, rgbToYuvSsse3 },
+#endif
+    };
+    static const Version<Blend> blendVersions[]=
+    {
+        { C, blendC },
+#ifdef HAVE_X86_KERNELS
+        { Sse2, blendSse2 },
+        { Avx2, blendAvx2 },
+        { Avx512, blendAvx512 },
+#endif
+    };
+    static const Version<Interleave> interleaveVersions[]=
+    {
+        { C, interleaveC },
+#ifdef HAVE_X86_KERNELS
+        { Sse2, interleaveSse2 },
+        { Avx2, interleaveAvx2 },
+#endif
+    };
+    static const Version<Dot> dotVersions[]=
+    {
+        { C, dotC },
+#ifdef HAVE_X86_KERNELS
+        { Sse2, dotSse2 },
+        { Avx2, dotAvx2 },
+        { Avx512, dotAvx512 },
+#endif
+    };
+
+    numBindings=0;
+    bind("rgbToBgra", rgbToBgra, rgbToBgraVersions, sizeof(rgbToBgraVersions)/sizeof(rgbToBgraVersions[0]), maxLevel);
+    bind("rgbToGray", rgbToGray, rgbToGrayVersions, sizeof(rgbToGrayVersions)/sizeof(rgbToGrayVersions[0]), maxLevel);
+    bind("yuy2ToYuv420Pal", yuy2ToYuv420Pal, yuy2ToYuv420PalVersions, sizeof(yuy2ToYuv420PalVersions)/sizeof(yuy2ToYuv420PalVersions[0]), maxLevel);
+    bind("yuy2ToYuv420Ntsc", yuy2ToYuv420Ntsc, yuy2ToYuv420NtscVersions, sizeof(yuy2ToYuv420NtscVersions)/sizeof(yuy2ToYuv420NtscVersions[0]), maxLevel);
+    bind("rgbToYuv", rgbToYuv, rgbToYuvVersions, sizeof(rgbToYuvVersions)/sizeof(rgbToYuvVersions[0]), maxLevel);
+    bind("blend", blend, blendVersions, sizeof(blendVersions)/sizeof(blendVersions[0]), maxLevel);
+    bind("interleave", interleave, interleaveVersions, sizeof(interleaveVersions)/sizeof(interleaveVersions[0]), maxLevel);
+    bind("dot", dot, dotVersions, sizeof(dotVersions)/sizeof(dotVersions[0]), maxLevel);
+    return true;
+}
+
+void list(FILE *f)
+{
+    fprintf(f, "CPU: %s, using: %s\n", name(cpuLevel), name(maxLevel));
+    for(int i=0; i<numBindings; ++i)
+    {
+        fprintf(f, "    %-16s %-8s (", bindings[i].name, name(bindings[i].used));
+        for(int l=C, n=0; l<NumLevels; ++l)
+            if(bindings[i].available&(1<<l))
+                fprintf(f, n++ ? " %s" : "%s", name((Level)l));
+        fprintf(f, ")\n");
+    }
+}
+
+}
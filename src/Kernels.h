@@ -0,0 +1,90 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#endif
+
+//
+// The hot pixel and audio loops, each with a portable C version and, on x86, versions for wider
+// instruction sets. init() binds each kernel to the best version that the CPU supports - or that
+// --cpu allows - once at start up, so that a portable build need not assume AVX2. Until then, the
+// C versions are used.
+namespace Kernels
+{
+    enum Level
+    {
+        C,
+        Sse2,
+        Ssse3,
+        Avx2,
+        Avx512,
+
+        NumLevels
+    };
+
+    //
+    // Convert pixels of RGB to the byte order of QImage::Format_RGB32 on little endian machines.
+    typedef void (*RgbToBgra)(const unsigned char *rgb, unsigned char *bgra, int pixels);
+    //
+    // Split a frame of packed YUY2 into 4:2:0 planes, taking the chroma of the even lines. There is a
+    // version of each for PAL and for NTSC, so that the line loops have constant trip counts.
+    typedef void (*Yuy2ToYuv420)(const uint8_t *src, uint8_t *y, uint8_t *cb, uint8_t *cr);
+    //
+    // Convert a line of RGB to luma, and the chroma of each pair of pixels - as used by the crufty
+    // deinterlacer. 'width' is in pixels.
+    typedef void (*RgbToYuv)(const unsigned char *rgb, uint8_t *y, uint8_t *cb, uint8_t *cr, int width);
+    //
+    // dst=(l1+(2*l2)+l3)/4 - the linear blend deinterlacer.
+    typedef void (*Blend)(const uint8_t *l1, const uint8_t *l2, const uint8_t *l3, uint8_t *dst, int bytes);
+    //
+    // Pack two channels of PCM into stereo.
+    typedef void (*Interleave)(const int16_t *left, const int16_t *right, int16_t *dst, int samples);
+    //
+    // Dot product, as used by the resampler's filters.
+    typedef float (*Dot)(const float *a, const float *b, int n);
+
+    extern RgbToBgra    rgbToBgra;
+    extern RgbToBgra    rgbToGray;
+    extern Yuy2ToYuv420 yuy2ToYuv420Pal;
+    extern Yuy2ToYuv420 yuy2ToYuv420Ntsc;
+    extern RgbToYuv     rgbToYuv;
+    extern Blend        blend;
+    extern Interleave   interleave;
+    extern Dot          dot;
+
+    extern Level        detect();
+    extern const char * name(Level level);
+    //
+    // 'cpu' is the name of a level, to use no kernels above it - or NULL to use the best the CPU
+    // supports. Fails if 'cpu' is not known, or not supported by this CPU.
+    extern bool         init(const char *cpu=0L);
+    //
+    // Print which version of each kernel is in use, and which others there are.
+    extern void         list(FILE *f);
+}
+
+#endif
@@ -22,13 +22,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "Clip.h"
+#include "SceneDetector.h"
+#include "FileWatcher.h"
+#include "Misc.h"
+#include "Server.h"
+#include "Kernels.h"
+#include <QtCore/QFileInfo>
+
+static const int constDefaultThumbnailInterval=60;
+static const int constDefaultFollowTimeout=10;
 
 static void usage(char *app)
 {
-    std::cerr << "Usage:" << app << "[options] <smil/dv/kdenlive>" << std::endl
+    std::cerr << "Usage:" << app << "[options] <smil/dv/avi/mov/kdenlive>" << std::endl
+              << std::endl
+              << "    Raw DV may also be read from stdin (-), or a FIFO. As this can only be read once," << std::endl
+              << "    it cannot be used for pictures, thumbnails, --checkpoint, or --dv with other outputs" << std::endl
               << std::endl
               << "    --info                 Print information" << std::endl
+              << "    --plan                 Print how the clips will be read, and the estimated I/O" << std::endl
               << "    --subtitles [file]     Output subtitles" << std::endl
               << "    --adjust <hours>       Adjust subtitle subtitle timestamp" << std::endl
               << "    --format <format>      Subtitle format - default " << CClipList::subtitleFormat << std::endl
@@ -39,15 +55,65 @@ static void usage(char *app)
               << "                             0 - no deinterlacing" << std::endl
               << "                             1 - bad deinterlacing" << std::endl
               << "                             2 - experimental 4:1:1 subsampling" << std::endl
+              << "    --quality <level>      Decode quality of YUV and pictures - default " << CClipList::quality << std::endl
+              << "                             0 - DC luma coefficients only (no colour), pictures from" << std::endl
+              << "                                 1/8 size image" << std::endl
+              << "                             1 - DC coefficients only" << std::endl
+              << "                             2 - DC and first AC pass" << std::endl
+              << "                             3 - best" << std::endl
               << "    --wav [file]           WAV file" << std::endl
+              << "    --rate <hz>            WAV sample rate - default is that of the 1st frame" << std::endl
+              << "    --resample <level>     WAV resampler - default " << CClipList::resampler << std::endl
+              << "                             0 - fast (nearest sample)" << std::endl
+              << "                             1 - high quality (windowed sinc)" << std::endl
               << "    --dvdauthor <file>     Create DVD author XML file" << std::endl
               << "                           Chapter names are output to <file>.chapters" << std::endl
               << "    --spumux <file>        Create spumux XML file" << std::endl
               << "    --kmf <file>           Create KMediaFactory XML file" << std::endl
               << "    --dv [file]            Raw DV file" << std::endl
+              << "    --scenes [file]        Detect recording breaks and shot changes, and output" << std::endl
+              << "                           the index. DVD chapters are placed on these boundaries" << std::endl
+              << "    --cut <level>          Shot change sensitivity (0.0 - 1.0) - default " << CSceneDetector::cutThreshold << std::endl
+              << "    --dupes [file]         Find repeated frames, and timecode that repeats or skips" << std::endl
+              << "                           frames, and output their (input) frame numbers" << std::endl
+              << "    --skip-dupes           Do not output repeated frames" << std::endl
               << "    --coverpic <file>      1st frame coverted to 1:1" << std::endl
               << "    --menupic <file>       1st frame" << std::endl
+              << "    --thumbnails <dest>    Create thumbnails - either a contact sheet (if <dest> ends" << std::endl
+              << "                           in .png or .jpg), or a folder of images" << std::endl
+              << "                           Use --quality 0 for the fastest (lowest quality) thumbnails" << std::endl
+              << "    --every <secs>         Thumbnail interval - default " << constDefaultThumbnailInterval << std::endl
+              << "    --shm <name>           Publish decoded 4:2:0 video and PCM audio to the shared" << std::endl
+              << "                           memory ring <name> - see catdv-shmread" << std::endl
+              << "    --sink <lib[:args]>    Load an output sink plugin, passing it [args] - may be" << std::endl
+              << "                           given more than once, see catdv-sink.h" << std::endl
+              << "    --threads <n>          Decode YUV and WAV with <n> threads - default " << CClipList::threads << std::endl
+              << "                           Only used when these are the only outputs, they are" << std::endl
+              << "                           regular files, and the audio does not need resampling" << std::endl
+              << "    --incremental          Copy the clips that are unchanged since the last --incremental" << std::endl
+              << "                           export from the previous YUV and WAV files, and only decode" << std::endl
+              << "                           the rest. Has the same restrictions as --threads" << std::endl
+              << "    --cache <MB>           Keep up to <MB> of decoded frames in memory, so that frames" << std::endl
+              << "                           used more than once in the project are only decoded once" << std::endl
+              << "    --cache-dir <dir>      Write frames that do not fit in the --cache to <dir>" << std::endl
+              << "    --checkpoint <file>    Save the state of the export to <file> every so often, so" << std::endl
+              << "                           that it may be resumed. Forces single threaded output" << std::endl
+              << "    --resume               Continue from the --checkpoint, if there is one" << std::endl
+              << "    --follow [secs]        The last file is a DV file that is still being captured -" << std::endl
+              << "                           output its frames as they are written, until it has not" << std::endl
+              << "                           grown for [secs], or is closed. Default " << constDefaultFollowTimeout << std::endl
               << "    --progress             Display progress to stderr" << std::endl
+              << "    --progress-fd <n>      Write the progress of YUV, WAV, subtitle, scene, and sink" << std::endl
+              << "                           output to file descriptor <n>, once a second, as JSON lines" << std::endl
+              << "    --cpu <level>          Use no kernels above <level> - one of c, sse2, ssse3, avx2," << std::endl
+              << "                           or avx512. Default is the best that the CPU supports" << std::endl
+              << "    --list-kernels         List which version of each kernel is used, and exit" << std::endl
+              << "    --serve <socket>       Keep catdv loaded, and run the jobs of clients connecting to" << std::endl
+              << "                           <socket>. Must be the only option. Jobs that use --cache," << std::endl
+              << "                           without --cache-dir, share their decoded frames" << std::endl
+              << "    --client <socket>      Run this job on the --serve server at <socket>. Must be the" << std::endl
+              << "                           1st option. If CATDV_SOCKET is set, jobs are run on that" << std::endl
+              << "                           server, or locally if it cannot be reached" << std::endl
               << "    --help                 Display this help" << std::endl;
 }
 
@@ -67,13 +133,38 @@ enum Mode
     Spumux     = 0x0400,
     Kmf        = 0x0800,
     Help       = 0x1000,
+    Scenes     = 0x2000,
+    Thumbnails = 0x4000,
+    Shm        = 0x8000,
+    Sink       = 0x10000,
+    Plan       = 0x20000,
+    Dupes      = 0x40000
 };
 
-int main(int argc, char **argv)
+//
+// Waits for the first frame of a file that is still being captured. An NTSC frame is smaller than a PAL one, so
+// wait for that much, and then for a whole PAL frame if the DSF bit of the header block says it is 625/50.
+static bool waitForFirstFrame(const char *file, int timeout)
+{
+    CFileWatcher  watcher(file, timeout);
+    unsigned char header[4];
+    int           fd;
+    bool          pal=false;
+
+    if(!watcher.waitFor(CClip::constNtscFrameSize) || -1==(fd=open(file, O_RDONLY)))
+        return false;
+    if(sizeof(header)==read(fd, header, sizeof(header)))
+        pal=header[3]&0x80;
+    close(fd);
+    return !pal || watcher.waitFor(CClip::constPalFrameSize);
+}
+
+static int run(int argc, char **argv)
 {
     static struct option opts[] =
     {
         {"info",        no_argument,       NULL, 'i'},
+        {"plan",        no_argument,       NULL, 'l'},
         {"subtitles",   optional_argument, NULL, 's'},
         {"adjust",      required_argument, NULL, 'a'},
         {"format",      required_argument, NULL, 'f'},
@@ -86,9 +177,30 @@ int main(int argc, char **argv)
         {"kmf",         required_argument, NULL, 'k'},
         {"dv",          optional_argument, NULL, 'v'},
         {"deinterlace", required_argument, NULL, 'p'},
+        {"quality",     required_argument, NULL, 'q'},
+        {"rate",        required_argument, NULL, 'r'},
+        {"resample",    required_argument, NULL, 'R'},
         {"coverpic",    required_argument, NULL, 'c'},
         {"menupic",     required_argument, NULL, 'm'},
+        {"scenes",      optional_argument, NULL, 'n'},
+        {"cut",         required_argument, NULL, 'u'},
+        {"dupes",       optional_argument, NULL, 'e'},
+        {"skip-dupes",  no_argument,       NULL, 'N'},
+        {"thumbnails",  required_argument, NULL, 'T'},
+        {"every",       required_argument, NULL, 'E'},
+        {"shm",         required_argument, NULL, 'M'},
+        {"sink",        required_argument, NULL, 'K'},
+        {"threads",     required_argument, NULL, 'j'},
+        {"cache",       required_argument, NULL, 'C'},
+        {"cache-dir",   required_argument, NULL, 'D'},
+        {"incremental", no_argument,       NULL, 'I'},
+        {"checkpoint",  required_argument, NULL, 'Q'},
+        {"resume",      no_argument,       NULL, 'U'},
+        {"follow",      optional_argument, NULL, 'F'},
         {"progress",    no_argument,       NULL, 'P'},
+        {"progress-fd", required_argument, NULL, 'G'},
+        {"cpu",         required_argument, NULL, 'X'},
+        {"list-kernels", no_argument,      NULL, 'L'},
         {"help",        no_argument,       NULL, 'h'},
         {0,             0,                 0,    0  }
     };
@@ -103,15 +215,23 @@ int main(int argc, char **argv)
             coverpicFile,
             menupicFile,
             spumuxFile,
-            kmfFile;
+            kmfFile,
+            scenesFile('-'),
+            dupesFile('-'),
+            thumbnailsDest,
+            shmName;
+    QStringList sinks;
+    const char *cpu=0L;
+    bool    listKernels=false;
     int     mode=None,
             adjust=0,
-            stdOut=0;
+            stdOut=0,
+            thumbnailInterval=constDefaultThumbnailInterval;
 
     for(;;)
     {
         int currentIndex(0),
-            ch=getopt_long(argc, argv, "is::f:x::z::d::v::hy::w::p:m:c:S:Pk:", opts, &currentIndex);
+            ch=getopt_long(argc, argv, "ils::f:x::z::d::v::hy::w::p:m:c:S:Pk:n::u:q:T:E:r:R:M:K:j:C:D:IQ:UF::G:X:Le::N", opts, &currentIndex);
 
         if (-1==ch)
             break;
@@ -122,6 +242,10 @@ int main(int argc, char **argv)
                 mode|=Info;
                 stdOut++;
                 break;
+            case 'l':
+                mode|=Plan;
+                stdOut++;
+                break;
             case 's':
                 mode|=Subtitles;
                 if(optarg && strcmp(optarg, "-"))
@@ -178,6 +302,15 @@ int main(int argc, char **argv)
             case 'p':
                 CClipList::deinterlace=strlen(optarg)==1 && isdigit(optarg[0]) ? atoi(optarg) : 100;
                 break;
+            case 'q':
+                CClipList::quality=strlen(optarg)==1 && isdigit(optarg[0]) ? atoi(optarg) : 100;
+                break;
+            case 'r':
+                CClipList::audioRate=atoi(optarg);
+                break;
+            case 'R':
+                CClipList::resampler=strlen(optarg)==1 && isdigit(optarg[0]) ? atoi(optarg) : 100;
+                break;
             case 'm':
                 menupicFile=optarg;
                 mode|=MenuPic;
@@ -194,20 +327,105 @@ int main(int argc, char **argv)
                 kmfFile=optarg;
                 mode|=Kmf;
                 break;
+            case 'n':
+                mode|=Scenes;
+                if(optarg && strcmp(optarg, "-"))
+                    scenesFile=optarg;
+                else
+                    stdOut++;
+                break;
+            case 'u':
+                CSceneDetector::cutThreshold=atof(optarg);
+                break;
+            case 'e':
+                mode|=Dupes;
+                if(optarg && strcmp(optarg, "-"))
+                    dupesFile=optarg;
+                else
+                    stdOut++;
+                break;
+            case 'N':
+                CClipList::skipDupes=true;
+                break;
+            case 'T':
+                thumbnailsDest=optarg;
+                mode|=Thumbnails;
+                break;
+            case 'E':
+                thumbnailInterval=atoi(optarg);
+                break;
+            case 'M':
+                shmName=optarg;
+                mode|=Shm;
+                break;
+            case 'K':
+                sinks << QString::fromLocal8Bit(optarg);
+                mode|=Sink;
+                break;
+            case 'j':
+                CClipList::threads=atoi(optarg);
+                break;
+            case 'C':
+                CClipList::cacheSize=atoi(optarg);
+                break;
+            case 'D':
+                CClipList::cacheDir=QString::fromLocal8Bit(optarg);
+                break;
+            case 'I':
+                CClipList::incremental=true;
+                break;
+            case 'Q':
+                CClipList::checkpointFile=QString::fromLocal8Bit(optarg);
+                break;
+            case 'U':
+                CClipList::resume=true;
+                break;
+            case 'F':
+                CClipList::followTimeout=optarg ? atoi(optarg) : constDefaultFollowTimeout;
+                break;
             case 'P':
                 CClipList::displayProgress=true;
                 break;
+            case 'G':
+            {
+                char *end=0L;
+
+                CClipList::progressFd=strtol(optarg, &end, 10);
+                if(!*optarg || *end || CClipList::progressFd<0 || -1==fcntl(CClipList::progressFd, F_GETFL))
+                    CClipList::progressFd=-2;
+                break;
+            }
+            case 'X':
+                cpu=optarg;
+                break;
+            case 'L':
+                listKernels=true;
+                break;
             case 'h':
             case '?':
                 mode|=Help;
         }
     }
                     
-    if(optind >= argc || None==mode || mode&Help || CClipList::deinterlace<0 || CClipList::deinterlace>2 ||
-       "-"==dvdAuthorFile || "-"==menupicFile || "-"==coverpicFile || "-"==spumuxFile)
+    if(!Kernels::init(cpu))
+        std::cerr << "ERROR: --cpu " << cpu << " is not known, or not supported by this CPU" << std::endl;
+    else if(listKernels)
+        Kernels::list(stdout);
+    else if(optind >= argc || None==mode || mode&Help || CClipList::deinterlace<0 || CClipList::deinterlace>2 ||
+       CClipList::quality<0 || CClipList::quality>3 || CClipList::resampler<0 || CClipList::resampler>1 ||
+       CClipList::audioRate<0 || (CClipList::audioRate>0 && CClipList::audioRate<8000) || CClipList::audioRate>192000 ||
+       CSceneDetector::cutThreshold<=0.0 || CSceneDetector::cutThreshold>1.0 ||
+       (CClipList::skipDupes && !(mode&(Wav|Yuv|Shm|Sink))) ||
+       "-"==dvdAuthorFile || "-"==menupicFile || "-"==coverpicFile || "-"==spumuxFile ||
+       "-"==thumbnailsDest || thumbnailInterval<1 || "-"==shmName || CClipList::threads<1 ||
+       CClipList::cacheSize<0 || "-"==CClipList::cacheDir || (!CClipList::cacheDir.isEmpty() && !CClipList::cacheSize) ||
+       "-"==CClipList::checkpointFile || (CClipList::resume && CClipList::checkpointFile.isEmpty()) ||
+       CClipList::followTimeout<0 || CClipList::progressFd<-1 || (CClipList::followTimeout && (!CClipList::checkpointFile.isEmpty() || !Misc::checkExt(argv[argc-1], "dv"))))
         usage(argv[0]);
     else if(stdOut>1)
         std::cerr << "ERROR: Only one file may be redirected to stdout" << std::endl;
+    else if(CClipList::followTimeout && !waitForFirstFrame(argv[argc-1], CClipList::followTimeout))
+        std::cerr << "ERROR: Nothing was written to " << argv[argc-1] << std::endl;
     else
     {
         CClipList clips(argv[optind]);
@@ -226,7 +444,13 @@ int main(int argc, char **argv)
             }
         }
 
-        if(clips.totalFrames() && clips.check())
+        if(clips.streaming() && (mode&(CoverPic|MenuPic|Thumbnails) || !CClipList::checkpointFile.isEmpty() ||
+                                 (mode&Dv && mode&(Subtitles|DvdAuthor|Wav|Yuv|Scenes|Dupes|Shm|Sink))))
+            std::cerr << "ERROR: A DV stream can only be read once" << std::endl;
+        else if(CClipList::followTimeout && (clips.isEmpty() || !clips.last().toEnd() || clips.last().container() ||
+                                             clips.last().fileName()!=QFileInfo(argv[argc-1]).absoluteFilePath()))
+            std::cerr << "ERROR: --follow requires the last clip to be all of " << argv[argc-1] << std::endl;
+        else if(clips.totalFrames() && clips.check())
         {
             if(mode&Info)
             {
@@ -237,23 +461,37 @@ int main(int argc, char **argv)
                                                clips.totalFrames(),
                                                ((double)clips.totalFrames())/(*it).frameRate());
             }
+            if(mode&Plan)
+                clips.outputPlan();
             if(mode&Dv)
                 clips.outputDv(dvFile);
-            if(mode&(Subtitles|DvdAuthor|Wav|Yuv))
+            if(mode&(Subtitles|DvdAuthor|Wav|Yuv|Scenes|Dupes|Shm|Sink))
                 clips.output(mode&Subtitles ? subFile : QString(),
                              mode&DvdAuthor ? dvdAuthorFile : QString(),
                              mode&Wav ? wavFile : QString(),
                              mode&Yuv ? yuvFile : QString(),
                              mode&Kmf ? kmfFile : QString(),
+                             mode&Scenes ? scenesFile : QString(),
+                             mode&Dupes ? dupesFile : QString(),
+                             mode&Shm ? shmName : QString(),
+                             sinks,
                              adjust);
             if(mode&SimpleSmil)
                 clips.outputSmil(true, simpleSmilFile);
             if(mode&Smil)
                 clips.outputSmil(false, smilFile);
-            if(mode&CoverPic)
-                clips.saveFrame(coverpicFile, false, true);
-            if(mode&MenuPic)
-                clips.saveFrame(menupicFile, false, false);
+            if(mode&(CoverPic|MenuPic))
+            {
+                QList<CClipList::Picture> pictures;
+
+                if(mode&CoverPic)
+                    pictures.append(CClipList::Picture(coverpicFile, false, true));
+                if(mode&MenuPic)
+                    pictures.append(CClipList::Picture(menupicFile, false, false));
+                clips.savePictures(pictures);
+            }
+            if(mode&Thumbnails)
+                clips.outputThumbnails(thumbnailsDest, thumbnailInterval);
             if(mode&Spumux)
                 clips.outputSpumux(spumuxFile, mode&Subtitles && "-"!=subFile ? subFile : QString());
             return clips.totalFrames();
@@ -264,3 +502,53 @@ int main(int argc, char **argv)
 
     return 0;
 }
+
+//
+// Called by a --serve server, before it forks a job, for each file that the job names. Loading it
+// leaves the index of any AVI or MOV that it uses with the server, for this and later jobs.
+static void warm(const QString &file)
+{
+    CClipList clips(file);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc>1 && 0==strcmp(argv[1], "--serve"))
+    {
+        if(3!=argc)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        return CServer(QString::fromLocal8Bit(argv[2])).exec(run, warm);
+    }
+
+    if(argc>1 && 0==strcmp(argv[1], "--client"))
+    {
+        if(argc<4)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+
+        const char *socket=argv[2];
+        int        status;
+
+        // Drop '--client <socket>', but keep the application name
+        argv[2]=argv[0];
+        if(!CServer::client(QString::fromLocal8Bit(socket), argc-2, argv+2, status))
+        {
+            std::cerr << "ERROR: Failed to connect to " << socket << std::endl;
+            return -1;
+        }
+        return status;
+    }
+
+    const char *socket=getenv("CATDV_SOCKET");
+    int        status;
+
+    if(socket && *socket && CServer::client(QString::fromLocal8Bit(socket), argc, argv, status))
+        return status;
+
+    return run(argc, argv);
+}
@@ -24,6 +24,7 @@
 #include <QtCore/QByteArray>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace Misc
@@ -92,4 +93,12 @@ QString getFile(const QString &f)
     return d;
 }
 
+bool preallocate(int fd, int64_t size)
+{
+    struct stat64 info;
+
+    // Only use the real thing - posix_fallocate() would emulate it by writing zeros
+    return size>0 && 0==fstat64(fd, &info) && S_ISREG(info.st_mode) && 0==fallocate64(fd, 0, 0, size);
+}
+
 }
@@ -21,6 +21,8 @@
   Boston, MA 02110-1301, USA.
 */
 
+#include <stdint.h>
+
 class QString;
 
 namespace Misc
@@ -34,6 +36,10 @@ namespace Misc
     extern QString dirSyntax(const QString &d);
     extern QString getFile(const QString &d);
     extern QString getDir(const QString &d);
+    //
+    // Reserve 'size' bytes for a regular file, so that it is laid out in as few extents as possible.
+    // This also sets the file size, so the caller should truncate it if less is written.
+    extern bool preallocate(int fd, int64_t size);
 }
 
 #endif
@@ -0,0 +1,187 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "PluginSink.h"
+#include "Frame.h"
+#include <QtCore/QFile>
+#include <QtCore/QLibrary>
+#include <string.h>
+
+static const int constMaxPcmSamples=1944*4;
+
+CPluginSinks::CPluginSinks(const QStringList &specs)
+            : itsWants(0),
+              itsFrame(0),
+              itsInput(0L),
+              itsPcm(0L)
+{
+    itsPlanes[0]=itsPlanes[1]=itsPlanes[2]=0L;
+    memset(&itsInfo, 0, sizeof(CatdvStreamInfo));
+
+    QStringList::ConstIterator it(specs.begin()),
+                               end(specs.end());
+
+    for(; it!=end && itsError.isEmpty(); ++it)
+    {
+        int            colon=(*it).indexOf(':');
+        QString        file(-1==colon ? *it : (*it).left(colon));
+        QLibrary       *lib=new QLibrary(file);
+        CatdvSinkEntry entry=(CatdvSinkEntry)lib->resolve(CATDV_SINK_ENTRY);
+        const CatdvSink *sink=entry ? entry() : 0L;
+
+        if(!sink)
+            itsError=file+" is not a catdv sink plugin ("+lib->errorString()+")";
+        else if((sink->version>>16)!=CATDV_SINK_VERSION_MAJOR || !sink->open || !sink->frame || !sink->close)
+            itsError=file+" was built for an incompatible version of catdv";
+        else
+        {
+            Plugin plugin;
+
+            plugin.lib=lib;
+            plugin.sink=sink;
+            plugin.ctx=0L;
+            plugin.args=-1==colon ? QByteArray() : QFile::encodeName((*it).mid(colon+1));
+            itsPlugins.append(plugin);
+            itsWants|=sink->wants;
+            continue;
+        }
+        delete lib;
+    }
+}
+
+CPluginSinks::~CPluginSinks()
+{
+    QList<Plugin>::ConstIterator it(itsPlugins.begin()),
+                                 end(itsPlugins.end());
+
+    for(; it!=end; ++it)
+    {
+        if((*it).ctx)
+            (*it).sink->close((*it).ctx);
+        (*it).lib->unload();
+        delete (*it).lib;
+    }
+
+    delete [] itsInput;
+    delete [] itsPlanes[0];
+    delete [] itsPcm;
+}
+
+bool CPluginSinks::Initialise(Frame &frame)
+{
+    AudioInfo info;
+
+    frame.GetAudioInfo(info);
+    itsInfo.width=frame.GetWidth();
+    itsInfo.height=frame.GetHeight();
+    itsInfo.pal=frame.IsPAL();
+    itsInfo.fps_num=itsInfo.pal ? 25 : 30000;
+    itsInfo.fps_den=itsInfo.pal ? 1 : 1001;
+    itsInfo.wide=frame.IsWide();
+    itsInfo.audio_rate=info.frequency;
+    itsInfo.audio_channels=frame.decoder->audio->num_channels;
+
+    if(itsWants&CATDV_SINK_WANTS_VIDEO)
+    {
+        int planeSize=itsInfo.width*itsInfo.height;
+
+        itsInput=new unsigned char[720 * 576 * 2];
+        itsPlanes[0]=new uint8_t[planeSize*3/2];
+        itsPlanes[1]=itsPlanes[0]+planeSize;
+        itsPlanes[2]=itsPlanes[1]+planeSize/4;
+    }
+    if(itsWants&CATDV_SINK_WANTS_AUDIO)
+        itsPcm=new int16_t[constMaxPcmSamples];
+
+    QList<Plugin>::Iterator it(itsPlugins.begin()),
+                            end(itsPlugins.end());
+
+    for(; it!=end; ++it)
+        if(!((*it).ctx=(*it).sink->open((*it).args.isEmpty() ? "" : (*it).args.constData(), &itsInfo)))
+        {
+            itsError=QString((*it).sink->name)+" failed to open";
+            return false;
+        }
+
+    return true;
+}
+
+bool CPluginSinks::Output(Frame &frame)
+{
+    CatdvFrameView view;
+
+    memset(&view, 0, sizeof(CatdvFrameView));
+    view.frame=itsFrame++;
+    view.dv=frame.data;
+    view.dv_size=frame.GetFrameSize();
+
+    if(itsWants&CATDV_SINK_WANTS_VIDEO)
+    {
+        frame.SetPreferredQuality();
+        frame.ExtractYUV420(itsInput, itsPlanes);
+        view.planes[0]=itsPlanes[0];
+        view.planes[1]=itsPlanes[1];
+        view.planes[2]=itsPlanes[2];
+        view.strides[0]=itsInfo.width;
+        view.strides[1]=view.strides[2]=itsInfo.width/2;
+    }
+
+    if(itsWants&CATDV_SINK_WANTS_AUDIO)
+    {
+        AudioInfo info;
+
+        frame.GetAudioInfo(info);
+        if(info.channels>0 && info.samples*info.channels<=constMaxPcmSamples)
+        {
+            frame.ExtractAudio(itsPcm);
+            view.pcm=itsPcm;
+            view.pcm_samples=info.samples;
+            view.pcm_channels=info.channels;
+            view.pcm_rate=info.frequency;
+        }
+    }
+
+    bool                    ok=true;
+    QList<Plugin>::Iterator it(itsPlugins.begin()),
+                            end(itsPlugins.end());
+
+    for(; it!=end; ++it)
+        if(0!=(*it).sink->frame((*it).ctx, &view))
+            ok=false;
+
+    return ok;
+}
+
+bool CPluginSinks::Flush()
+{
+    bool                    ok=true;
+    QList<Plugin>::Iterator it(itsPlugins.begin()),
+                            end(itsPlugins.end());
+
+    for(; it!=end; ++it)
+        if((*it).ctx)
+        {
+            if(0!=(*it).sink->close((*it).ctx))
+                ok=false;
+            (*it).ctx=0L;
+        }
+
+    return ok;
+}
@@ -0,0 +1,72 @@
+#ifndef PLUGIN_SINK_H
+#define PLUGIN_SINK_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <stdint.h>
+#include "catdv-sink.h"
+#include "Sink.h"
+
+class Frame;
+class QLibrary;
+
+//
+// Loads the --sink plugins, and feeds them each frame - decoding only what the plugins want, and
+// only once for all of them.
+class CPluginSinks : public CSink
+{
+    public:
+
+    CPluginSinks(const QStringList &specs);
+    ~CPluginSinks();
+
+    //
+    // Returns the error from loading the plugins, if any
+    const QString & error() const { return itsError; }
+    bool            Initialise(Frame &frame);
+    bool            Output(Frame &frame);
+    bool            Flush();
+
+    private:
+
+    struct Plugin
+    {
+        QLibrary        *lib;
+        const CatdvSink *sink;
+        void            *ctx;
+        QByteArray      args;
+    };
+
+    QList<Plugin>   itsPlugins;
+    QString         itsError;
+    int             itsWants;
+    uint64_t        itsFrame;
+    unsigned char   *itsInput;
+    uint8_t         *itsPlanes[3];
+    int16_t         *itsPcm;
+    CatdvStreamInfo itsInfo;
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "PositionalWriter.h"
+#include "Misc.h"
+#include <QtCore/QFile>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+bool CPositionalWriter::isRegular(const QString &name)
+{
+    struct stat64 info;
+
+    if("-"==name)
+        return false;
+
+    return 0==stat64(QFile::encodeName(name).constData(), &info) ? S_ISREG(info.st_mode) : ENOENT==errno;
+}
+
+//
+// The file is allocated up front, so that blocks written out of order do not fragment it.
+CPositionalWriter::CPositionalWriter(const QString &name, int64_t size)
+                 : itsFd(open64(QFile::encodeName(name).constData(), O_RDWR|O_CREAT|O_TRUNC|O_LARGEFILE, 0644)),
+                   itsName(name)
+{
+    if(-1!=itsFd)
+    {
+        Misc::preallocate(itsFd, size); // Not supported everywhere, and not required.
+        if(0!=ftruncate64(itsFd, size))
+        {
+            close(itsFd);
+            itsFd=-1;
+        }
+    }
+}
+
+CPositionalWriter::~CPositionalWriter()
+{
+    if(-1!=itsFd)
+        close(itsFd);
+}
+
+bool CPositionalWriter::write(int64_t offset, const void *data, size_t size)
+{
+    const unsigned char *d=(const unsigned char *)data;
+
+    while(size)
+    {
+        ssize_t written=pwrite64(itsFd, d, size, offset);
+
+        if(written<0 && EINTR==errno)
+            continue;
+        if(written<=0)
+            return false;
+        d+=written;
+        offset+=written;
+        size-=written;
+    }
+    return true;
+}
+
+//
+// Copy 'length' bytes, starting at 'from' in 'fd', to 'offset'. Where the source and destination
+// are equally aligned, the whole blocks are shared with the source (a reflink) if the filesystem
+// supports this. Anything else is copied within the kernel, or - failing that - read and written.
+bool CPositionalWriter::copy(int64_t offset, int fd, int64_t from, int64_t length)
+{
+#ifdef FICLONERANGE
+    struct stat64 info;
+
+    if(0==fstat64(itsFd, &info) && info.st_blksize>0 && (offset%info.st_blksize)==(from%info.st_blksize))
+    {
+        int64_t head=(info.st_blksize-(offset%info.st_blksize))%info.st_blksize,
+                blocks=((length-head)/info.st_blksize)*info.st_blksize;
+
+        if(head<length && blocks>0)
+        {
+            struct file_clone_range range;
+
+            range.src_fd=fd;
+            range.src_offset=from+head;
+            range.src_length=blocks;
+            range.dest_offset=offset+head;
+
+            if(0==ioctl(itsFd, FICLONERANGE, &range))
+                return copy(offset, fd, from, head) &&
+                       copy(offset+head+blocks, fd, from+head+blocks, length-(head+blocks));
+        }
+    }
+#endif
+
+    while(length>0)
+    {
+        loff_t  in=from,
+                out=offset;
+        ssize_t copied=copy_file_range(fd, &in, itsFd, &out, length, 0);
+
+        if(copied<0 && EINTR==errno)
+            continue;
+        if(copied<=0)
+            break;
+        from+=copied;
+        offset+=copied;
+        length-=copied;
+    }
+
+    static const int constBufferSize=1024*1024;
+
+    unsigned char *buffer=length>0 ? new unsigned char[constBufferSize] : 0L;
+    bool          ok=true;
+
+    while(ok && length>0)
+    {
+        ssize_t got=pread64(fd, buffer, length<constBufferSize ? length : constBufferSize, from);
+
+        if(got<0 && EINTR==errno)
+            continue;
+        ok=got>0 && write(offset, buffer, got);
+        from+=got;
+        offset+=got;
+        length-=got;
+    }
+
+    delete [] buffer;
+    return ok;
+}
@@ -0,0 +1,53 @@
+#ifndef POSITIONAL_WRITER_H
+#define POSITIONAL_WRITER_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <stdint.h>
+#include <sys/types.h>
+
+//
+// Writes blocks at known offsets, from any number of threads, into a file of known size.
+class CPositionalWriter
+{
+    public:
+
+    //
+    // Returns true if 'name' is, or would be, a regular file - i.e. not stdout, a pipe, etc.
+    static bool isRegular(const QString &name);
+
+    CPositionalWriter(const QString &name, int64_t size);
+    ~CPositionalWriter();
+
+    operator bool() const        { return -1!=itsFd; }
+
+    const QString & name() const { return itsName; }
+    bool            write(int64_t offset, const void *data, size_t size);
+    bool            copy(int64_t offset, int fd, int64_t from, int64_t length);
+
+    private:
+
+    int     itsFd;
+    QString itsName;
+};
+
+#endif
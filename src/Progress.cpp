@@ -0,0 +1,204 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Progress.h"
+#include "SinkThread.h"
+#include <QtCore/QMutexLocker>
+#include <QtCore/QString>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+
+static const int    constInterval=1000; // ms
+static const double constSmoothing=0.3;
+static const double constMinSample=0.1; // seconds
+
+// The report of the export in progress, for failed()
+static CProgress *running=0L;
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+(ts.tv_nsec/1000000000.0);
+}
+
+static QByteArray jsonString(const QString &str)
+{
+    QByteArray in(str.toUtf8()),
+               out("\"");
+
+    for(int i=0; i<in.size(); ++i)
+    {
+        unsigned char c=in[i];
+
+        if('"'==c || '\\'==c)
+            out.append('\\').append(c);
+        else if(c<0x20)
+            out.append(QString().sprintf("\\u%04x", c).toLatin1());
+        else
+            out.append(c);
+    }
+    return out.append('"');
+}
+
+CProgress::CProgress(int fd, int64_t total, const QList<CSinkThread *> &sinks)
+         : itsFd(fd),
+           itsTotal(total),
+           itsSinks(sinks),
+           itsFrames(0),
+           itsFinished(false),
+           itsOk(true),
+           itsFailed(false),
+           itsStart(now()),
+           itsLastTime(itsStart),
+           itsFps(0.0),
+           itsLastFrames(0)
+{
+    running=this;
+}
+
+CProgress::~CProgress()
+{
+    finish(true);
+    if(running==this)
+        running=0L;
+}
+
+void CProgress::failed(int fd)
+{
+    if(running)
+        running->finish(false);
+    else if(fd>=0)
+        CProgress(fd, 0).report("failed");
+}
+
+void CProgress::finish(bool ok)
+{
+    {
+        QMutexLocker locker(&itsMutex);
+
+        if(itsFinished)
+            return;
+        itsFinished=true;
+        itsOk=ok;
+        itsStop.wakeOne();
+    }
+    wait();
+}
+
+void CProgress::run()
+{
+    sigset_t pipe;
+
+    // If the reader goes away, write() should fail rather than SIGPIPE killing the export
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, 0L);
+
+    QMutexLocker locker(&itsMutex);
+
+    while(!itsFinished)
+    {
+        itsStop.wait(&itsMutex, constInterval);
+        if(!itsFinished)
+        {
+            locker.unlock();
+            report("running");
+            locker.relock();
+        }
+    }
+
+    report(itsOk ? "done" : "failed");
+}
+
+void CProgress::report(const char *state)
+{
+    if(itsFailed)
+        return;
+
+    double  time=now(),
+            elapsed=time-itsStart;
+    int64_t frames=itsFrames.load();
+
+    // Exponentially smoothed rate, so that the ETA does not jump about with each sample. Very short
+    // intervals - i.e. the final line straight after a sample - would only add noise.
+    if(time-itsLastTime>=constMinSample)
+    {
+        double fps=(frames-itsLastFrames)/(time-itsLastTime);
+
+        itsFps=itsLastFrames || itsLastTime>itsStart ? (constSmoothing*fps)+((1.0-constSmoothing)*itsFps) : fps;
+        itsLastTime=time;
+        itsLastFrames=frames;
+    }
+
+    QByteArray line(QString().sprintf("{\"state\":\"%s\",\"elapsed\":%.1f,\"frames\":%lld", state, elapsed, (long long)frames).toLatin1());
+
+    if(itsTotal>0)
+        line.append(QString().sprintf(",\"total\":%lld,\"percent\":%.1f", (long long)itsTotal, (frames*100.0)/itsTotal).toLatin1());
+    else
+        line.append(",\"total\":null,\"percent\":null");
+
+    line.append(QString().sprintf(",\"fps\":%.1f", itsFps).toLatin1());
+
+    if(itsTotal>0 && itsFps>0.0)
+        line.append(QString().sprintf(",\"eta\":%.1f", frames<itsTotal ? (itsTotal-frames)/itsFps : 0.0).toLatin1());
+    else
+        line.append(",\"eta\":null");
+
+    line.append(",\"sinks\":[");
+    for(int i=0; i<itsSinks.count(); ++i)
+    {
+        int64_t sinkFrames,
+                sinkBytes;
+
+        itsSinks[i]->position(sinkFrames, sinkBytes);
+        if(i)
+            line.append(',');
+        line.append("{\"name\":").append(jsonString(itsSinks[i]->name()))
+            .append(QString().sprintf(",\"frames\":%lld", (long long)sinkFrames).toLatin1());
+        if(sinkBytes>=0)
+            line.append(QString().sprintf(",\"bytes\":%lld", (long long)sinkBytes).toLatin1());
+        line.append('}');
+    }
+    line.append("]}\n");
+
+    // Give up on the first error, rather than hold up the export
+    const char *p=line.constData();
+    int        left=line.size();
+
+    while(left)
+    {
+        ssize_t w=write(itsFd, p, left);
+
+        if(w<0 && EINTR==errno)
+            continue;
+        if(w<=0)
+        {
+            itsFailed=true;
+            break;
+        }
+        p+=w;
+        left-=w;
+    }
+}
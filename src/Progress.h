@@ -0,0 +1,86 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QList>
+#include <QtCore/QByteArray>
+#include <stdint.h>
+
+class CSinkThread;
+
+//
+// Writes the progress of an export to a file descriptor, as one JSON object per line - for use by
+// job schedulers, rather than people. The export only stores the number of frames done, and a thread
+// of its own reports this once a second, along with the smoothed rate, the estimated time left, and
+// how far each sink has got. e.g.
+//
+//   {"state":"running","elapsed":12.0,"frames":3000,"total":90000,"percent":3.3,"fps":250.2,"eta":347.6,
+//    "sinks":[{"name":"yuv file out.yuv","frames":2990,"bytes":1865760000}]}
+//
+// 'total' and 'eta' are null when reading from a stream. The last line has a 'state' of "done" or
+// "failed".
+class CProgress : public QThread
+{
+    public:
+
+    CProgress(int fd, int64_t total, const QList<CSinkThread *> &sinks=QList<CSinkThread *>());
+    ~CProgress();
+
+    void setFrames(int64_t frames) { itsFrames.store(frames); }
+    //
+    // Stop the thread, once it has written the final line. The sinks must still exist.
+    void finish(bool ok);
+    //
+    // For errors that exit(). Finishes the running report as "failed" - or, if the export stopped before
+    // one was created, writes a lone "failed" line to 'fd'.
+    static void failed(int fd);
+
+    protected:
+
+    void run();
+
+    private:
+
+    void report(const char *state);
+
+    private:
+
+    int                    itsFd;
+    int64_t                itsTotal;
+    QList<CSinkThread *>   itsSinks;
+    QAtomicInteger<qint64> itsFrames;
+    QMutex                 itsMutex;
+    QWaitCondition         itsStop;
+    bool                   itsFinished,
+                           itsOk,
+                           itsFailed;
+    double                 itsStart,
+                           itsLastTime,
+                           itsFps;
+    int64_t                itsLastFrames;
+};
+
+#endif
@@ -0,0 +1,541 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "ReadPlan.h"
+#include "FileWatcher.h"
+#include "Stream.h"
+#include "Container.h"
+#include <QtCore/QFile>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Frames are read in blocks of (up to) this many frames
+static const int constMaxNumFrames=100;
+
+// How much of the next read to ask the kernel to prefetch
+static const int64_t constPrefetchSize=8*1024*1024;
+
+// Clips that repeat frames are found by looking up the buckets, of this many frames, that they read
+static const int64_t constBucketFrames=250;
+
+// Used for the --plan cost estimate only
+static const double constSeekSecs=0.010;
+static const double constReadBytesPerSec=40.0*1024.0*1024.0;
+
+CReadPlan::CReadPlan()
+{
+    init();
+}
+
+CReadPlan::~CReadPlan()
+{
+    clear();
+}
+
+void CReadPlan::init()
+{
+    itsClip=0;
+    itsClipPos=0;
+    itsMaxFrameSize=0;
+    itsPrefetched=-1;
+    itsBufferFile=-1;
+    itsBufferFrameSize=0;
+    itsLastRead=-1;
+    itsLastFrame=-1;
+    itsBufferFrom=itsBufferCount=0;
+    itsGrowth=0;
+    itsBuffer=0L;
+    itsWatcher=0L;
+}
+
+void CReadPlan::clear()
+{
+    QList<File>::ConstIterator it(itsFiles.begin()),
+                               end(itsFiles.end());
+
+    itsClip=itsSteps.count();
+    release(0);
+
+    for(; it!=end; ++it)
+        if(-1!=(*it).fd)
+            close((*it).fd);
+
+    delete [] itsBuffer;
+    delete itsWatcher;
+    itsFiles.clear();
+    itsFileIndexes.clear();
+    itsReads.clear();
+    itsSteps.clear();
+    itsStepBuckets.clear();
+    init();
+}
+
+//
+// Clips must be added in output order. A clip is merged into the previous read if it is from the
+// same file, and starts within, or immediately after, that read.
+void CReadPlan::add(const QString &file, int64_t from, int64_t count, int frameSize, CStream *stream,
+                    const CContainer *container)
+{
+    if(count<=0)
+        return;
+
+    int  index=fileIndex(file);
+    Step step;
+
+    itsFiles[index].stream=stream;
+    itsFiles[index].container=container;
+    if(container)
+    {
+        itsFiles[index].device=container->device();
+        itsFiles[index].inode=container->inode();
+        itsFiles[index].size=container->fileSize();
+        itsFiles[index].mtime=container->mtime();
+    }
+
+    if(itsReads.count() && itsReads.last().file==index && itsReads.last().frameSize==frameSize &&
+       from>=itsReads.last().from && from<=itsReads.last().from+itsReads.last().count)
+    {
+        Read &read(itsReads.last());
+
+        if(from+count>read.from+read.count)
+            read.count=(from+count)-read.from;
+        step.start=from-read.from;
+    }
+    else
+    {
+        Read read;
+
+        read.file=index;
+        read.frameSize=frameSize;
+        read.from=from;
+        read.count=count;
+        itsReads.append(read);
+        step.start=0;
+    }
+
+    step.read=itsReads.count()-1;
+    step.count=count;
+
+    // Note which earlier clips overlap this one, so that their frames may be cached. Only the steps
+    // that read the same buckets of frames from this file are checked.
+    int newStep=itsSteps.count();
+
+    for(int64_t b=from/constBucketFrames; b<=(from+count-1)/constBucketFrames; ++b)
+    {
+        QList<int> &steps(itsStepBuckets[qMakePair(index, b)]);
+
+        for(int i=0; i<steps.count(); ++i)
+        {
+            Step       &other(itsSteps[steps[i]]);
+            const Read &read(itsReads[other.read]);
+            int64_t    sFrom=read.from+other.start;
+
+            if(sFrom<from+count && sFrom+other.count>from && (other.repeats.isEmpty() || other.repeats.last()!=newStep))
+                other.repeats.append(newStep);
+        }
+        steps.append(newStep);
+    }
+    itsSteps.append(step);
+
+    if(frameSize>itsMaxFrameSize)
+        itsMaxFrameSize=frameSize;
+}
+
+//
+// Keep reading the last clip's file as it grows, until it has not grown for 'timeout' seconds, or
+// is closed. The last clip must run to the end of its file.
+void CReadPlan::follow(int timeout)
+{
+    delete itsWatcher;
+    itsWatcher=itsSteps.isEmpty() ? 0L : new CFileWatcher(itsFiles[itsReads[itsSteps.last().read].file].name, timeout);
+}
+
+//
+// The number of frames the last clip has grown by since this was last called.
+int64_t CReadPlan::takeGrowth()
+{
+    int64_t growth=itsGrowth;
+
+    itsGrowth=0;
+    return growth;
+}
+
+void CReadPlan::rewind()
+{
+    itsClip=0;
+    itsClipPos=0;
+    itsPrefetched=-1;
+    itsLastRead=-1;
+}
+
+//
+// Continue from frame 'pos' of clip 'clip' - as given by currentClip() and clipPosition().
+void CReadPlan::seek(int clip, int64_t pos)
+{
+    rewind();
+    itsClip=clip;
+    itsClipPos=pos;
+}
+
+unsigned char * CReadPlan::next()
+{
+    if(itsClip==itsSteps.count()-1 && itsClipPos>=itsSteps[itsClip].count && (itsWatcher || lastStream()))
+        grow();
+
+    while(itsClip<itsSteps.count() && itsClipPos>=itsSteps[itsClip].count)
+    {
+        itsClip++;
+        itsClipPos=0;
+    }
+
+    if(itsClip>=itsSteps.count())
+        return 0L;
+
+    const Step &step(itsSteps[itsClip]);
+    const Read &read(itsReads[step.read]);
+    int64_t    f=read.from+step.start+itsClipPos;
+
+    if(itsFiles[read.file].container)
+    {
+        const CContainer *container=itsFiles[read.file].container;
+
+        // Keep the kernel a block ahead
+        if(0==itsClipPos || 0==(f-read.from)%constMaxNumFrames)
+            container->willNeed(f, 2*constMaxNumFrames);
+
+        itsClipPos++;
+        itsLastRead=step.read;
+        itsLastFrame=f;
+        return (unsigned char *)container->frame(f);
+    }
+
+    if(read.file!=itsBufferFile || f<itsBufferFrom || f>=itsBufferFrom+itsBufferCount)
+        if(!fill(step.read, f))
+        {
+            // As before, a clip that cannot be read is skipped
+            itsClipPos=step.count;
+            return next();
+        }
+
+    itsClipPos++;
+    itsLastRead=step.read;
+    itsLastFrame=f;
+    return itsBuffer+((f-itsBufferFrom)*read.frameSize);
+}
+
+//
+// Identifies the frame last returned by next(), for CFrameCache.
+CFrameCache::Key CReadPlan::currentKey() const
+{
+    CFrameCache::Key key;
+
+    if(itsLastRead>=0 && itsClip<itsSteps.count())
+    {
+        const Read       &read(itsReads[itsLastRead]);
+        const File       &file(itsFiles[read.file]);
+        const QList<int> &repeats(itsSteps[itsClip].repeats);
+
+        if(0==file.inode)
+            return key;
+
+        key.device=file.device;
+        key.inode=file.inode;
+        key.size=file.size;
+        key.mtime=file.mtime;
+        key.offset=file.container ? file.container->offset(itsLastFrame) : itsLastFrame*read.frameSize;
+
+        for(int r=0; r<repeats.count() && !key.keep; ++r)
+        {
+            const Step &step(itsSteps[repeats[r]]);
+            int64_t    from=itsReads[step.read].from+step.start;
+
+            key.keep=itsLastFrame>=from && itsLastFrame<from+step.count;
+        }
+    }
+
+    return key;
+}
+
+//
+// Print the reads, and an estimate of their cost compared to reading each clip separately.
+void CReadPlan::dump(FILE *f) const
+{
+    int64_t reads=0,
+            seeks=0,
+            bytes=0,
+            clipReads=0,
+            clipBytes=0,
+            bufferFrom=0,
+            bufferCount=0;
+    int     bufferFile=-1,
+            lastFile=-1;
+    int64_t lastEnd=-1;
+
+    fprintf(f, "Read plan: %d clip(s), %d file(s), %d read(s)\n", itsSteps.count(), itsFiles.count(), itsReads.count());
+
+    for(int r=0; r<itsReads.count(); ++r)
+    {
+        const Read &read(itsReads[r]);
+        int        first=-1,
+                   last=-1;
+
+        for(int s=0; s<itsSteps.count(); ++s)
+            if(itsSteps[s].read==r)
+            {
+                if(-1==first)
+                    first=s;
+                last=s;
+            }
+
+        fprintf(f, "  %4d: %s frames %lld-%lld, %lld bytes at %lld, clip(s) %d-%d\n", r+1,
+                QFile::encodeName(itsFiles[read.file].name).constData(),
+                (long long)read.from, (long long)(read.from+read.count-1), (long long)(read.count*read.frameSize),
+                (long long)(read.from*read.frameSize), first+1, last+1);
+    }
+
+    // Walk the clips as next() would, counting the reads and seeks that it makes
+    for(int s=0; s<itsSteps.count(); ++s)
+    {
+        const Step &step(itsSteps[s]);
+        const Read &read(itsReads[step.read]);
+
+        for(int64_t pos=read.from+step.start, end=pos+step.count; pos<end;)
+        {
+            if(read.file==bufferFile && pos>=bufferFrom && pos<bufferFrom+bufferCount)
+            {
+                pos=bufferFrom+bufferCount;
+                continue;
+            }
+
+            bufferFile=read.file;
+            bufferFrom=pos;
+            bufferCount=read.from+read.count-pos;
+            if(bufferCount>constMaxNumFrames)
+                bufferCount=constMaxNumFrames;
+
+            if(read.file!=lastFile || pos*read.frameSize!=lastEnd)
+                seeks++;
+            lastFile=read.file;
+            lastEnd=(pos+bufferCount)*read.frameSize;
+            reads++;
+            bytes+=bufferCount*read.frameSize;
+        }
+
+        clipReads+=(step.count+constMaxNumFrames-1)/constMaxNumFrames;
+        clipBytes+=step.count*read.frameSize;
+    }
+
+    fprintf(f, "Estimated I/O:   %d open(s), %lld seek(s), %lld read(s), %lld bytes, %.1fs\n",
+            itsFiles.count(), (long long)seeks, (long long)reads, (long long)bytes,
+            (seeks*constSeekSecs)+(bytes/constReadBytesPerSec));
+    fprintf(f, "Clip by clip:    %d open(s), %d seek(s), %lld read(s), %lld bytes, %.1fs\n",
+            itsSteps.count(), itsSteps.count(), (long long)clipReads, (long long)clipBytes,
+            (itsSteps.count()*constSeekSecs)+(clipBytes/constReadBytesPerSec));
+}
+
+int CReadPlan::fileIndex(const QString &name)
+{
+    if(itsFileIndexes.contains(name))
+        return itsFileIndexes[name];
+
+    File file;
+
+    file.name=name;
+    file.fd=-1;
+    file.device=file.inode=0;
+    file.size=file.mtime=0;
+    file.stream=0L;
+    file.container=0L;
+    itsFiles.append(file);
+    itsFileIndexes.insert(name, itsFiles.count()-1);
+    return itsFiles.count()-1;
+}
+
+int CReadPlan::fileDescriptor(int index)
+{
+    File &file(itsFiles[index]);
+
+    if(-1==file.fd)
+    {
+        file.fd=open64(QFile::encodeName(file.name).constData(), O_RDONLY|O_LARGEFILE);
+        if(-1!=file.fd)
+        {
+            struct stat64 info;
+
+            posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            if(0==fstat64(file.fd, &info))
+            {
+                file.device=info.st_dev;
+                file.inode=info.st_ino;
+                file.size=info.st_size;
+                file.mtime=(((int64_t)info.st_mtim.tv_sec)*1000000000)+info.st_mtim.tv_nsec;
+            }
+        }
+    }
+
+    return file.fd;
+}
+
+//
+// Read a block of frames, starting at 'f', from read 'r'. Files are opened when first needed, and
+// stay open until the plan is cleared.
+bool CReadPlan::fill(int r, int64_t f)
+{
+    const Read &read(itsReads[r]);
+    CStream    *stream=itsFiles[read.file].stream;
+    int        fd=stream ? -1 : fileDescriptor(read.file);
+
+    if(-1==fd && !stream)
+        return false;
+
+    if(!itsBuffer)
+        itsBuffer=new unsigned char[constMaxNumFrames*itsMaxFrameSize];
+
+    int64_t count=read.from+read.count-f;
+
+    if(count>constMaxNumFrames)
+        count=constMaxNumFrames;
+
+    release(f);
+
+    ssize_t got=stream ? stream->read(itsBuffer, count)*read.frameSize
+                       : pread64(fd, itsBuffer, count*read.frameSize, f*read.frameSize);
+
+    itsBufferFile=read.file;
+    itsBufferFrameSize=read.frameSize;
+    itsBufferFrom=f;
+    itsBufferCount=got>0 ? got/read.frameSize : 0;
+
+    // This is the last block of the read, so start the next one coming in while it is decoded
+    if(f+count>=read.from+read.count)
+        prefetch(r+1);
+
+    return itsBufferCount>0;
+}
+
+//
+// Drop the frames in the buffer from the page cache - unless a later clip, or the rest of the
+// current one, still needs them. 'f' is the frame about to be read.
+void CReadPlan::release(int64_t f)
+{
+    if(itsBufferCount<=0 || -1==itsFiles[itsBufferFile].fd)
+        return;
+
+    int64_t from=itsBufferFrom,
+            to=itsBufferFrom+itsBufferCount;
+
+    for(int s=itsClip; s<itsSteps.count(); ++s)
+    {
+        const Step &step(itsSteps[s]);
+        const Read &read(itsReads[step.read]);
+
+        if(read.file==itsBufferFile)
+        {
+            int64_t stepFrom=s==itsClip ? f : read.from+step.start,
+                    stepTo=read.from+step.start+step.count;
+
+            if(stepFrom<to && stepTo>from)
+                return;
+        }
+    }
+
+    posix_fadvise(itsFiles[itsBufferFile].fd, from*itsBufferFrameSize, (to-from)*itsBufferFrameSize, POSIX_FADV_DONTNEED);
+}
+
+//
+// Wait for at least one more complete frame to be written to the last clip's file, and then add
+// all of the complete frames there are to the clip. Following stops once the wait fails. Frames
+// from a stream are read straight into the buffer, as they cannot be read again.
+void CReadPlan::grow()
+{
+    Step    &step(itsSteps.last());
+    Read    &read(itsReads[step.read]);
+    int64_t end=read.from+read.count;
+    CStream *stream=lastStream();
+
+    if(stream)
+    {
+        if(!itsBuffer)
+            itsBuffer=new unsigned char[constMaxNumFrames*itsMaxFrameSize];
+
+        int frames=stream->read(itsBuffer, constMaxNumFrames);
+
+        if(frames>0)
+        {
+            itsBufferFile=read.file;
+            itsBufferFrameSize=read.frameSize;
+            itsBufferFrom=end;
+            itsBufferCount=frames;
+            read.count+=frames;
+            step.count+=frames;
+            itsGrowth+=frames;
+        }
+        return;
+    }
+
+    if(!itsWatcher->waitFor((end+1)*read.frameSize))
+    {
+        delete itsWatcher;
+        itsWatcher=0L;
+        return;
+    }
+
+    int64_t frames=(itsWatcher->size()/read.frameSize)-end;
+
+    read.count+=frames;
+    step.count+=frames;
+    itsGrowth+=frames;
+}
+
+//
+// The stream the last clip is read from, if it is a stream that has not ended.
+CStream * CReadPlan::lastStream() const
+{
+    CStream *stream=itsSteps.isEmpty() ? 0L : itsFiles[itsReads[itsSteps.last().read].file].stream;
+
+    return stream && !stream->atEnd() ? stream : 0L;
+}
+
+//
+// Ask the kernel to start reading the first part of read 'r'. This is asynchronous, so the
+// switch to the next file does not stall on a cold read.
+void CReadPlan::prefetch(int r)
+{
+    if(r>=itsReads.count() || r<=itsPrefetched)
+        return;
+
+    const Read &read(itsReads[r]);
+    const File &file(itsFiles[read.file]);
+
+    itsPrefetched=r;
+    if(file.container)
+    {
+        file.container->willNeed(read.from, constPrefetchSize/read.frameSize);
+        return;
+    }
+
+    int        fd=file.stream ? -1 : fileDescriptor(read.file);
+    int64_t    length=read.count*read.frameSize;
+
+    if(-1!=fd)
+        posix_fadvise(fd, read.from*read.frameSize, length<constPrefetchSize ? length : constPrefetchSize, POSIX_FADV_WILLNEED);
+}
@@ -0,0 +1,128 @@
+#ifndef READ_PLAN_H
+#define READ_PLAN_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include "FrameCache.h"
+#include <stdint.h>
+#include <stdio.h>
+
+class CFileWatcher;
+class CStream;
+class CContainer;
+
+//
+// Sequential reader for a list of clips. Clips that touch, or overlap, a previous clip in the same
+// file are merged into one read, so that frames are read in large blocks across clip boundaries,
+// and each file is only opened once. The start of the next read is prefetched, and frames that
+// are no longer needed are dropped from the page cache. When following, or when it is a CStream,
+// the last clip is extended as more frames arrive. Frames of an AVI, or MOV, are not copied, but
+// used from the file's mapping.
+class CReadPlan
+{
+    public:
+
+    CReadPlan();
+    CReadPlan(const CReadPlan &)            { init(); } // The plan is rebuilt by CClipList::reset()
+    ~CReadPlan();
+
+    CReadPlan & operator=(const CReadPlan &) { clear(); return *this; }
+
+    void            clear();
+    void            add(const QString &file, int64_t from, int64_t count, int frameSize, CStream *stream=0L,
+                        const CContainer *container=0L);
+    void            follow(int timeout);
+    int64_t         takeGrowth();
+    void            rewind();
+    unsigned char * next();
+    void            seek(int clip, int64_t pos);
+    int             currentClip() const      { return itsClip; }
+    int64_t         clipPosition() const     { return itsClipPos; }
+    CFrameCache::Key currentKey() const;
+    void            dump(FILE *f) const;
+
+    private:
+
+    struct File
+    {
+        QString  name;
+        int      fd;
+        uint64_t device,
+                 inode;
+        int64_t  size,
+                 mtime;   // ns
+        CStream          *stream;    // Read in order, rather than from 'fd'
+        const CContainer *container; // Frames are used straight from its mapping
+    };
+
+    struct Read
+    {
+        int     file,
+                frameSize;
+        int64_t from,
+                count;
+    };
+
+    struct Step
+    {
+        int        read;
+        int64_t    start,  // Relative to the start of the read
+                   count;
+        QList<int> repeats; // Later steps that read some of the same frames
+    };
+
+    void            init();
+    int             fileIndex(const QString &name);
+    int             fileDescriptor(int index);
+    bool            fill(int r, int64_t f);
+    void            release(int64_t f);
+    void            prefetch(int r);
+    void            grow();
+    CStream *       lastStream() const;
+
+    private:
+
+    QList<File>         itsFiles;
+    QHash<QString, int> itsFileIndexes;
+    QList<Read>         itsReads;
+    QList<Step>         itsSteps;
+    // The steps that read each bucket of frames, of each file
+    QHash<QPair<int, int64_t>, QList<int> > itsStepBuckets;
+    int                 itsClip,
+                        itsMaxFrameSize,
+                        itsPrefetched,
+                        itsBufferFile,
+                        itsBufferFrameSize,
+                        itsLastRead;
+    int64_t             itsClipPos,
+                        itsLastFrame,
+                        itsBufferFrom,
+                        itsBufferCount,
+                        itsGrowth;
+    unsigned char       *itsBuffer;
+    CFileWatcher        *itsWatcher;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "SceneDetector.h"
+#include "Frame.h"
+#include <string.h>
+#include <stdlib.h>
+
+double CSceneDetector::cutThreshold=0.4;
+
+static const int constMaxDateGap=2;   // Seconds
+static const int constMinCutGap=10;   // Frames
+static const int constDifBlockSize=80;
+
+bool CSceneDetector::isValid(const TimeCode &tc)
+{
+    return tc.hour>=0 && tc.hour<=23 && tc.min>=0 && tc.min<=59 && tc.sec>=0 && tc.sec<=59 && tc.frame>=0 && tc.frame<=29;
+}
+
+int64_t CSceneDetector::toFrames(const TimeCode &tc, bool pal)
+{
+    return ((((int64_t)tc.hour*60)+tc.min)*60+tc.sec)*(pal ? 25 : 30)+tc.frame;
+}
+
+QString CSceneDetector::reasonStr(int reasons)
+{
+    QString str;
+
+    if(reasons&Start)
+        str+=",start";
+    if(reasons&NewRecording)
+        str+=",rec";
+    if(reasons&DateJump)
+        str+=",date";
+    if(reasons&TimeCodeJump)
+        str+=",timecode";
+    if(reasons&Cut)
+        str+=",cut";
+
+    return str.isEmpty() ? str : str.mid(1);
+}
+
+CSceneDetector::CSceneDetector()
+              : itsLastTimeCode(-1),
+                itsLastCut(-1),
+                itsLastDate(-1),
+                itsCurrentHistogram(0),
+                itsHaveHistogram(false)
+{
+}
+
+//
+// Frame headers must already have been parsed, i.e. frame.ExtractHeader()
+int CSceneDetector::process(const Frame &frame, int64_t frameNum)
+{
+    int reasons=(0==frameNum ? Start : None) |
+                (frame.IsNewRecording() ? NewRecording : None) |
+                dateJump(frame) |
+                timeCodeJump(frame) |
+                cut(frame);
+
+    if(Cut==reasons && itsLastCut>-1 && (frameNum-itsLastCut)<constMinCutGap)
+        reasons=None;
+
+    if(reasons&Cut)
+        itsLastCut=frameNum;
+
+    if(None!=reasons)
+        itsIndex.append(Boundary(frameNum, reasons));
+
+    return reasons;
+}
+
+//
+// Carry on from a --checkpoint. 'previous' is the last frame processed before the checkpoint, and is
+// only used to compare the next frame against.
+void CSceneDetector::resume(const QList<Boundary> &index, int64_t lastCut, const Frame &previous)
+{
+    itsIndex=index;
+    itsLastCut=lastCut;
+    timeCodeJump(previous);
+    dateJump(previous);
+    cut(previous);
+}
+
+int CSceneDetector::timeCodeJump(const Frame &frame)
+{
+    TimeCode tc;
+
+    if(!frame.GetTimeCode(tc) || !isValid(tc))
+        return None;
+
+    bool    pal=frame.IsPAL();
+    int64_t current=toFrames(tc, pal),
+            diff=current-itsLastTimeCode;
+    bool    jump=itsLastTimeCode>-1 && (diff<0 || diff>(pal ? 25 : 30));
+
+    itsLastTimeCode=current;
+    return jump ? TimeCodeJump : None;
+}
+
+int CSceneDetector::dateJump(const Frame &frame)
+{
+    struct tm date;
+
+    if(!frame.GetRecordingDate(date))
+        return None;
+
+    time_t current=timegm(&date);
+
+    if(-1==current)
+        return None;
+
+    bool jump=-1!=itsLastDate && (current<itsLastDate || (current-itsLastDate)>constMaxDateGap);
+
+    itsLastDate=current;
+    return jump ? DateJump : None;
+}
+
+//
+// Each video DIF block holds one macroblock - 4 luma DCT blocks of 14 bytes followed by 2 chroma
+// blocks of 10 bytes. The first 9 bits of each DCT block are its (signed) DC coefficient, so a luma
+// histogram can be built straight from the compressed data.
+int CSceneDetector::cut(const Frame &frame)
+{
+    static const int constLumaBlocks[4]={ 4, 18, 32, 46 };
+
+    int                 *hist=itsHistogram[itsCurrentHistogram],
+                        *prev=itsHistogram[itsCurrentHistogram ? 0 : 1],
+                        total=0;
+    const unsigned char *block=frame.data,
+                        *end=frame.data+frame.GetFrameSize();
+
+    memset(hist, 0, sizeof(int)*constHistogramBins);
+
+    for(; block<end; block+=constDifBlockSize)
+        if(0x80==(block[0]&0xE0)) // Video DIF block
+            for(int b=0; b<4; ++b)
+            {
+                const unsigned char *dct=block+constLumaBlocks[b];
+                int                 dc=(dct[0]<<1)|(dct[1]>>7);
+
+                if(dc&0x100)
+                    dc-=0x200;
+
+                hist[(dc+0x100)>>3]++;
+                total++;
+            }
+
+    bool haveHistogram=itsHaveHistogram,
+         isCut=false;
+
+    itsHaveHistogram=total>0;
+    itsCurrentHistogram=itsCurrentHistogram ? 0 : 1;
+
+    if(haveHistogram && total)
+    {
+        int diff=0;
+
+        for(int i=0; i<constHistogramBins; ++i)
+            diff+=abs(hist[i]-prev[i]);
+
+        isCut=(((double)diff)/(2.0*total))>cutThreshold;
+    }
+
+    return isCut ? Cut : None;
+}
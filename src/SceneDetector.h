@@ -0,0 +1,90 @@
+#ifndef SCENE_DETECTOR_H
+#define SCENE_DETECTOR_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <stdint.h>
+#include <time.h>
+
+class Frame;
+struct TimeCode;
+
+//
+// Detects recording breaks and shot changes without decoding the video. A frame is a boundary if
+// it carries the REC START flag, if the recording date or timecode jumps, or if the histogram of the
+// luma DC coefficients differs too much from that of the previous frame.
+class CSceneDetector
+{
+    public:
+
+    enum Reason
+    {
+        None         = 0x00,
+        Start        = 0x01,
+        NewRecording = 0x02,
+        DateJump     = 0x04,
+        TimeCodeJump = 0x08,
+        Cut          = 0x10
+    };
+
+    struct Boundary
+    {
+        Boundary(int64_t f=0, int r=None) : frame(f), reasons(r) { }
+
+        int64_t frame;
+        int     reasons;
+    };
+
+    static double cutThreshold;
+
+    static bool    isValid(const TimeCode &tc);
+    static int64_t toFrames(const TimeCode &tc, bool pal);
+    static QString reasonStr(int reasons);
+
+    CSceneDetector();
+
+    int                     process(const Frame &frame, int64_t frameNum);
+    void                    resume(const QList<Boundary> &index, int64_t lastCut, const Frame &previous);
+    const QList<Boundary> & index() const   { return itsIndex; }
+    int64_t                 lastCut() const { return itsLastCut; }
+
+    private:
+
+    int                     timeCodeJump(const Frame &frame);
+    int                     dateJump(const Frame &frame);
+    int                     cut(const Frame &frame);
+
+    private:
+
+    static const int constHistogramBins=64;
+
+    QList<Boundary> itsIndex;
+    int64_t         itsLastTimeCode,
+                    itsLastCut;
+    time_t          itsLastDate;
+    int             itsHistogram[2][constHistogramBins],
+                    itsCurrentHistogram;
+    bool            itsHaveHistogram;
+};
+
+#endif
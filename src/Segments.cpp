@@ -0,0 +1,130 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Segments.h"
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+
+static const char *constMagic="catdv-segments 1";
+
+bool CSegmentManifest::identify(const QString &file, Segment &segment)
+{
+    struct stat64 info;
+
+    if(0!=stat64(QFile::encodeName(file).constData(), &info))
+        return false;
+
+    segment.device=info.st_dev;
+    segment.inode=info.st_ino;
+    segment.size=info.st_size;
+    segment.mtime=(((int64_t)info.st_mtim.tv_sec)*1000000000)+info.st_mtim.tv_nsec;
+    return true;
+}
+
+bool CSegmentManifest::load(const QString &output)
+{
+    QFile file(fileName(output));
+
+    itsSegments.clear();
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QTextStream str(&file);
+
+    if(str.readLine()!=constMagic || str.readLine()!=itsSettings)
+        return false;
+
+    while(!str.atEnd())
+    {
+        QString            line(str.readLine());
+        unsigned long long device,
+                           inode;
+        long long          size,
+                           mtime,
+                           from,
+                           count,
+                           offset,
+                           length;
+
+        if(line.isEmpty())
+            continue;
+
+        if(8!=sscanf(line.toLatin1().constData(), "%llu %llu %lld %lld %lld %lld %lld %lld",
+                     &device, &inode, &size, &mtime, &from, &count, &offset, &length))
+        {
+            itsSegments.clear();
+            return false;
+        }
+
+        Segment segment;
+
+        segment.device=device;
+        segment.inode=inode;
+        segment.size=size;
+        segment.mtime=mtime;
+        segment.from=from;
+        segment.count=count;
+        segment.offset=offset;
+        segment.length=length;
+        itsSegments.append(segment);
+    }
+
+    return true;
+}
+
+bool CSegmentManifest::save(const QString &output) const
+{
+    QFile file(fileName(output));
+
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QTextStream                    str(&file);
+    QList<Segment>::ConstIterator it(itsSegments.begin()),
+                                  end(itsSegments.end());
+
+    str << constMagic << endl
+        << itsSettings << endl;
+
+    for(; it!=end; ++it)
+        str << (unsigned long long)(*it).device << ' ' << (unsigned long long)(*it).inode << ' '
+            << (long long)(*it).size << ' ' << (long long)(*it).mtime << ' '
+            << (long long)(*it).from << ' ' << (long long)(*it).count << ' '
+            << (long long)(*it).offset << ' ' << (long long)(*it).length << endl;
+
+    return true;
+}
+
+const CSegmentManifest::Segment * CSegmentManifest::find(const Segment &segment) const
+{
+    QList<Segment>::ConstIterator it(itsSegments.begin()),
+                                  end(itsSegments.end());
+
+    for(; it!=end; ++it)
+        if((*it).device==segment.device && (*it).inode==segment.inode && (*it).size==segment.size &&
+           (*it).mtime==segment.mtime && (*it).from<=segment.from &&
+           (*it).from+(*it).count>=segment.from+segment.count)
+            return &(*it);
+
+    return 0L;
+}
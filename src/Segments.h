@@ -0,0 +1,72 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <stdint.h>
+
+//
+// Records which byte range of an output file came from which range of frames of which DV file, so
+// that an --incremental export can copy the ranges that have not changed from the previous output.
+// The manifest is saved as <output>.segments
+class CSegmentManifest
+{
+    public:
+
+    struct Segment
+    {
+        uint64_t device,
+                 inode;
+        int64_t  size,
+                 mtime,
+                 from,   // 1st frame, and number of frames, in the DV file
+                 count,
+                 offset, // Where these frames are in the output
+                 length;
+    };
+
+    static QString fileName(const QString &output) { return output+".segments"; }
+
+    //
+    // Fill in the identity of 'file' - i.e. everything except the ranges.
+    static bool    identify(const QString &file, Segment &segment);
+
+    CSegmentManifest(const QString &settings) : itsSettings(settings) { }
+
+    //
+    // Fails if there is no manifest, or it was written with different settings.
+    bool            load(const QString &output);
+    bool            save(const QString &output) const;
+    void            add(const Segment &segment) { itsSegments.append(segment); }
+
+    //
+    // Find a previous segment, of the same file, that contains all of the frames of 'segment'.
+    const Segment * find(const Segment &segment) const;
+
+    private:
+
+    QString        itsSettings;
+    QList<Segment> itsSegments;
+};
+
+#endif
@@ -0,0 +1,456 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Server.h"
+#include "FrameCache.h"
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QList>
+#include <QtGui/QImageWriter>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+static const char     constMagic[]="catdv-job 1";
+static const uint32_t constMaxRequest=1024*1024;
+// How long a client has to send its request - as these are read by the server itself
+static const int      constRequestTimeout=5;
+// The most that the frame cache directory, that jobs share, may hold
+static const int64_t  constSharedCacheSize=2048LL*1024*1024;
+
+static bool address(const QByteArray &name, struct sockaddr_un &addr)
+{
+    if(name.isEmpty() || name.size()>=(int)sizeof(addr.sun_path))
+        return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    strcpy(addr.sun_path, name.constData());
+    return true;
+}
+
+static int connectTo(const QByteArray &name)
+{
+    struct sockaddr_un addr;
+
+    if(!address(name, addr))
+        return -1;
+
+    int fd=socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+
+    if(fd>=0 && 0!=connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd);
+        fd=-1;
+    }
+    return fd;
+}
+
+static bool readFully(int fd, void *buffer, size_t size)
+{
+    char *p=(char *)buffer;
+
+    while(size)
+    {
+        ssize_t r=read(fd, p, size);
+
+        if(r<0 && EINTR==errno)
+            continue;
+        if(r<=0)
+            return false;
+        p+=r;
+        size-=r;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t size)
+{
+    const char *p=(const char *)buffer;
+
+    while(size)
+    {
+        ssize_t w=write(fd, p, size);
+
+        if(w<0 && EINTR==errno)
+            continue;
+        if(w<=0)
+            return false;
+        p+=w;
+        size-=w;
+    }
+    return true;
+}
+
+//
+// Read a request into the client's stdin, stdout and stderr, and its working directory followed by its
+// arguments. Any descriptors received are put into 'fds', even if the rest of the request is invalid,
+// so that the caller can close them.
+static bool readRequest(int fd, int fds[3], QList<QByteArray> &args)
+{
+    uint32_t       size=0;
+    char           control[CMSG_SPACE(sizeof(int)*3)];
+    struct iovec   iov;
+    struct msghdr  msg;
+    struct cmsghdr *cmsg;
+    struct timeval timeout;
+
+    timeout.tv_sec=constRequestTimeout;
+    timeout.tv_usec=0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base=&size;
+    iov.iov_len=sizeof(size);
+    msg.msg_iov=&iov;
+    msg.msg_iovlen=1;
+    msg.msg_control=control;
+    msg.msg_controllen=sizeof(control);
+
+    ssize_t got=recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+
+    if(got>0 && (cmsg=CMSG_FIRSTHDR(&msg)) && SOL_SOCKET==cmsg->cmsg_level && SCM_RIGHTS==cmsg->cmsg_type)
+    {
+        const int *received=(const int *)CMSG_DATA(cmsg);
+        int       count=(cmsg->cmsg_len-CMSG_LEN(0))/sizeof(int);
+
+        if(3==count)
+            memcpy(fds, received, sizeof(int)*3);
+        else
+            for(int i=0; i<count; ++i)
+                close(received[i]);
+    }
+
+    if(sizeof(size)!=got || -1==fds[0] || size<=sizeof(constMagic) || size>constMaxRequest)
+        return false;
+
+    QByteArray request(size, '\0');
+
+    if(!readFully(fd, request.data(), size) || '\0'!=request[size-1] ||
+       0!=memcmp(request.constData(), constMagic, sizeof(constMagic)))
+        return false;
+
+    // Split into the working directory, and arguments
+    args=request.mid(sizeof(constMagic), size-sizeof(constMagic)-1).split('\0');
+    return args.count()>=2;
+}
+
+//
+// The request is the size of the rest of the request - sent with stdin, stdout and stderr attached -
+// followed by the magic, working directory and arguments, each nul terminated.
+bool CServer::client(const QString &socket, int argc, char **argv, int &status)
+{
+    int fd=connectTo(QFile::encodeName(socket));
+
+    if(fd<0)
+        return false;
+
+    QByteArray request(constMagic, sizeof(constMagic));
+    char       *cwd=getcwd(0L, 0);
+
+    request.append(cwd ? cwd : "/");
+    request.append('\0');
+    free(cwd);
+    for(int i=0; i<argc; ++i)
+    {
+        request.append(argv[i]);
+        request.append('\0');
+    }
+
+    uint32_t       size=request.size();
+    int            fds[3]={ STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char           control[CMSG_SPACE(sizeof(fds))];
+    struct iovec   iov;
+    struct msghdr  msg;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base=&size;
+    iov.iov_len=sizeof(size);
+    msg.msg_iov=&iov;
+    msg.msg_iovlen=1;
+    msg.msg_control=control;
+    msg.msg_controllen=sizeof(control);
+    cmsg=CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level=SOL_SOCKET;
+    cmsg->cmsg_type=SCM_RIGHTS;
+    cmsg->cmsg_len=CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t result;
+    bool    ok=sizeof(size)==sendmsg(fd, &msg, MSG_NOSIGNAL) &&
+               writeFully(fd, request.constData(), request.size()) &&
+               readFully(fd, &result, sizeof(result));
+
+    close(fd);
+    if(!ok)
+    {
+        std::cerr << "ERROR: Lost connection to " << QFile::encodeName(socket).constData() << std::endl;
+        status=-1;
+    }
+    else
+        status=result;
+    return true;
+}
+
+CServer::CServer(const QString &socket)
+       : itsSocket(QFile::encodeName(socket)),
+         itsFd(-1)
+{
+}
+
+CServer::~CServer()
+{
+    if(itsFd>=0)
+    {
+        close(itsFd);
+        unlink(itsSocket.constData());
+    }
+    if(!itsCacheDir.isEmpty())
+        QDir(QFile::decodeName(itsCacheDir)).removeRecursively();
+}
+
+int CServer::exec(Job job, Warm warm)
+{
+    struct sockaddr_un addr;
+
+    if(!address(itsSocket, addr))
+    {
+        std::cerr << "ERROR: Invalid socket name " << itsSocket.constData() << std::endl;
+        return -1;
+    }
+
+    int fd=connectTo(itsSocket);
+
+    if(fd>=0)
+    {
+        close(fd);
+        std::cerr << "ERROR: A server is already listening on " << itsSocket.constData() << std::endl;
+        return -1;
+    }
+
+    // Only the user that started the server may use it
+    mode_t mask=umask(0077);
+
+    unlink(itsSocket.constData());
+    itsFd=socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if(itsFd<0 || 0!=bind(itsFd, (struct sockaddr *)&addr, sizeof(addr)) || 0!=listen(itsFd, 64))
+    {
+        umask(mask);
+        std::cerr << "ERROR: Failed to listen on " << itsSocket.constData() << std::endl;
+        return -1;
+    }
+    umask(mask);
+
+    // Load the image plugins now, rather than in each job
+    QImageWriter::supportedImageFormats();
+
+    QByteArray cacheDir(QFile::encodeName(QDir::tempPath()+"/catdv-serve-XXXXXX"));
+
+    if(mkdtemp(cacheDir.data()))
+    {
+        itsCacheDir=cacheDir;
+        CFrameCache::sharedDir=QFile::decodeName(cacheDir);
+    }
+
+    // Connection handlers are never waited for
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    for(;;)
+    {
+        int conn=accept4(itsFd, 0L, 0L, SOCK_CLOEXEC);
+
+        if(conn<0)
+        {
+            if(EINTR==errno || ECONNABORTED==errno)
+                continue;
+            std::cerr << "ERROR: Failed to accept connection - " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        struct ucred cred;
+        socklen_t    len=sizeof(cred);
+
+        if(0==getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) && cred.uid==getuid())
+        {
+            int               fds[3]={ -1, -1, -1 };
+            QList<QByteArray> args;
+
+            if(readRequest(conn, fds, args))
+            {
+                QDir dir(QFile::decodeName(args[0]));
+
+                // args[1] is the application name
+                for(int i=2; i<args.count(); ++i)
+                {
+                    QByteArray    file(QFile::encodeName(dir.absoluteFilePath(QFile::decodeName(args[i]))));
+                    struct stat64 info;
+
+                    if(!args[i].isEmpty() && '-'!=args[i][0] && 0==stat64(file.constData(), &info) && S_ISREG(info.st_mode))
+                        warm(QFile::decodeName(file));
+                }
+                prune();
+
+                pid_t pid=fork();
+
+                if(0==pid)
+                {
+                    close(itsFd);
+                    itsFd=-1;
+                    itsCacheDir=QByteArray();
+                    handle(conn, fds, args, job);
+                    _exit(0);
+                }
+                if(pid<0)
+                    std::cerr << "ERROR: Failed to start job - " << strerror(errno) << std::endl;
+            }
+
+            for(int i=0; i<3; ++i)
+                if(fds[i]>=0)
+                    close(fds[i]);
+        }
+        close(conn);
+    }
+
+    return 0;
+}
+
+//
+// Called in a process forked for the connection. This forks the job, and then waits for it to finish -
+// killing it if the client goes away first.
+void CServer::handle(int fd, int fds[3], QList<QByteArray> args, Job job)
+{
+    signal(SIGCHLD, SIG_DFL);
+
+    pid_t pid=fork();
+
+    if(0==pid)
+    {
+        QByteArray dir(args.takeFirst());
+        char       **argv=new char *[args.count()+1];
+
+        // Move the descriptors out of the way first, in case any were received as 0, 1 or 2
+        for(int i=0; i<3; ++i)
+        {
+            int moved=fcntl(fds[i], F_DUPFD_CLOEXEC, 3);
+
+            close(fds[i]);
+            fds[i]=moved;
+        }
+        for(int i=0; i<3; ++i)
+        {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+        close(fd);
+        signal(SIGPIPE, SIG_DFL);
+        if(0!=chdir(dir.constData()))
+        {
+            std::cerr << "ERROR: Failed to change to " << dir.constData() << std::endl;
+            _exit(-1);
+        }
+
+        for(int i=0; i<args.count(); ++i)
+            argv[i]=args[i].data();
+        argv[args.count()]=0L;
+
+        int status=job(args.count(), argv);
+
+        // exit() would also run the server's atexit handlers and static destructors, so only flush what
+        // the job has written
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(0L);
+        _exit(status);
+    }
+
+    for(int i=0; i<3; ++i)
+        close(fds[i]);
+
+    int32_t result=-1;
+
+    if(pid>0)
+    {
+        for(;;)
+        {
+            struct pollfd pfd;
+            int           status;
+            pid_t         r=waitpid(pid, &status, WNOHANG);
+
+            if(r==pid)
+            {
+                result=WIFEXITED(status)
+                        ? WEXITSTATUS(status)
+                        : WIFSIGNALED(status)
+                            ? 128+WTERMSIG(status)
+                            : -1;
+                break;
+            }
+            if(r<0 && EINTR!=errno)
+                break;
+
+            // The client sends nothing more, so the socket is only readable once it has closed
+            pfd.fd=fd;
+            pfd.events=POLLIN;
+            pfd.revents=0;
+            if(poll(&pfd, 1, 250)>0)
+            {
+                kill(pid, SIGTERM);
+                waitpid(pid, &status, 0);
+                return;
+            }
+        }
+    }
+
+    writeFully(fd, &result, sizeof(result));
+}
+
+//
+// Keep the frame cache directory that jobs share within its budget, dropping the oldest entries first.
+void CServer::prune()
+{
+    if(itsCacheDir.isEmpty())
+        return;
+
+    QFileInfoList                files(QDir(QFile::decodeName(itsCacheDir)).entryInfoList(QDir::Files, QDir::Time));
+    QFileInfoList::ConstIterator it(files.begin()),
+                                 end(files.end());
+    int64_t                      total=0;
+
+    for(; it!=end; ++it)
+        if((total+=(*it).size())>constSharedCacheSize)
+            QFile::remove((*it).absoluteFilePath());
+}
@@ -0,0 +1,68 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+//
+// Runs catdv jobs for local clients, so that these do not pay for process start up, loading Qt and
+// its image plugins, and setting up libdv. A client passes its stdin, stdout and stderr, working
+// directory and arguments over a Unix socket, and gets the job's exit status back. Each job is run in
+// a process forked from the (warm) server, as catdv's settings are global and errors exit(). Before
+// forking, the server 'warms' the files that a job names - so that what is parsed stays with the server,
+// and is inherited by later jobs. Jobs that use --cache share their decoded frames through a directory
+// that the server owns.
+class CServer
+{
+    public:
+
+    typedef int  (*Job)(int argc, char **argv);
+    typedef void (*Warm)(const QString &file);
+
+    //
+    // Run 'argv' (which starts with the application name) on the server listening on 'socket'.
+    // Returns false if the server could not be reached, otherwise 'status' is the job's exit status.
+    static bool client(const QString &socket, int argc, char **argv, int &status);
+
+    CServer(const QString &socket);
+    ~CServer();
+
+    //
+    // Accept jobs until killed, running each with 'job' - after calling 'warm' for each regular file
+    // that the job's arguments name.
+    int  exec(Job job, Warm warm);
+
+    private:
+
+    void handle(int fd, int fds[3], QList<QByteArray> args, Job job);
+    void prune();
+
+    private:
+
+    QByteArray itsSocket,
+               itsCacheDir;
+    int        itsFd;
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+//
+// Reference consumer for catdv --shm. Attaches to the ring as a reader, and writes the video as
+// YUV4MPEG2 to stdout, and (optionally) the audio as raw 16 bit little endian PCM to a file.
+
+#include "ShmRing.h"
+#include <iostream>
+#include <string>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const int constWaitTime=1000; // ms
+
+static bool writeAll(int fd, const unsigned char *data, size_t size)
+{
+    while(size)
+    {
+        ssize_t written=write(fd, data, size);
+
+        if(written<0 && EINTR==errno)
+            continue;
+        if(written<=0)
+            return false;
+        data+=written;
+        size-=written;
+    }
+    return true;
+}
+
+static bool producerAlive(const Shm::Header *h)
+{
+    return !(0!=kill(h->producer, 0) && ESRCH==errno);
+}
+
+//
+// Claim a free reader entry, starting at the producer's current position.
+static Shm::Reader * attach(Shm::Header *h)
+{
+    int32_t self=getpid();
+
+    for(int r=0; r<Shm::constMaxReaders; ++r)
+    {
+        Shm::Reader *reader=&h->readers[r];
+        int32_t     unused=0;
+
+        if(__atomic_compare_exchange_n(&reader->pid, &unused, -self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&reader->readIndex, __atomic_load_n(&h->writeIndex, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            __atomic_store_n(&reader->pid, self, __ATOMIC_RELEASE);
+            return reader;
+        }
+    }
+    return 0L;
+}
+
+static void detach(Shm::Header *h, Shm::Reader *reader)
+{
+    __atomic_store_n(&reader->pid, 0, __ATOMIC_RELEASE);
+    Shm::futexWake(&h->readSeq);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc<2 || argc>3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <name> [pcm file]" << std::endl
+                  << std::endl
+                  << "Reads the catdv --shm <name> ring, writing YUV4MPEG2 to stdout and raw" << std::endl
+                  << "16 bit little endian PCM to [pcm file]" << std::endl;
+        return -1;
+    }
+
+    std::string name(argv[1]);
+
+    if('/'!=name[0])
+        name="/"+name;
+
+    int fd=shm_open(name.c_str(), O_RDWR, 0);
+
+    if(-1==fd)
+    {
+        std::cerr << "ERROR: Failed to open " << name << std::endl;
+        return -1;
+    }
+
+    struct stat info;
+    void        *mem=0==fstat(fd, &info) && info.st_size>=(off_t)sizeof(Shm::Header)
+                        ? mmap(0L, info.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+
+    close(fd);
+
+    Shm::Header *h=MAP_FAILED!=mem ? (Shm::Header *)mem : 0L;
+
+    if(!h || 0!=memcmp(h->magic, Shm::constMagic, sizeof(h->magic)) || Shm::constVersion!=h->version ||
+       (off_t)Shm::totalSize(h)>info.st_size)
+    {
+        std::cerr << "ERROR: " << name << " is not a catdv frame ring" << std::endl;
+        return -1;
+    }
+
+    int pcm=argc>2 ? open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0644) : -1;
+
+    if(argc>2 && -1==pcm)
+    {
+        std::cerr << "ERROR: Failed to create " << argv[2] << std::endl;
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    Shm::Reader *reader=attach(h);
+
+    if(!reader)
+    {
+        std::cerr << "ERROR: Too many readers" << std::endl;
+        return -1;
+    }
+
+    bool ok=true,
+         header=false;
+
+    while(ok)
+    {
+        uint32_t seq=__atomic_load_n(&h->writeSeq, __ATOMIC_ACQUIRE);
+        uint64_t index=__atomic_load_n(&reader->readIndex, __ATOMIC_ACQUIRE);
+
+        if(!header && __atomic_load_n(&h->ready, __ATOMIC_ACQUIRE))
+        {
+            ok=writeAll(STDOUT_FILENO, (const unsigned char *)h->y4mHeader, strlen(h->y4mHeader));
+            header=true;
+        }
+
+        uint64_t writeIndex=__atomic_load_n(&h->writeIndex, __ATOMIC_ACQUIRE);
+
+        if(header && index<writeIndex)
+        {
+            const Shm::Slot     *slot=Shm::slot(h, index);
+            const unsigned char *data=((const unsigned char *)slot)+sizeof(Shm::Slot);
+
+            // The producer should never overwrite a slot before it has been read - but if it has,
+            // skip to the newest frame rather than output a torn one
+            if(slot->frame!=index || slot->videoSize>(uint32_t)Shm::constMaxVideoSize ||
+               slot->audioSize>(uint32_t)Shm::constMaxAudioSize)
+            {
+                std::cerr << "WARNING: Frame " << index << " was overwritten, skipping to frame " << writeIndex << std::endl;
+                __atomic_store_n(&reader->readIndex, writeIndex, __ATOMIC_RELEASE);
+                Shm::futexWake(&h->readSeq);
+                continue;
+            }
+
+            ok=writeAll(STDOUT_FILENO, (const unsigned char *)"FRAME\n", 6) &&
+               writeAll(STDOUT_FILENO, data, slot->videoSize) &&
+               (-1==pcm || writeAll(pcm, data+slot->videoSize, slot->audioSize));
+
+            __atomic_store_n(&reader->readIndex, index+1, __ATOMIC_RELEASE);
+            Shm::futexWake(&h->readSeq);
+        }
+        else if(__atomic_load_n(&h->eof, __ATOMIC_ACQUIRE))
+            break;
+        else if(!producerAlive(h))
+        {
+            std::cerr << "ERROR: catdv has exited" << std::endl;
+            ok=false;
+        }
+        else
+            Shm::futexWait(&h->writeSeq, seq, constWaitTime);
+    }
+
+    detach(h, reader);
+    if(-1!=pcm)
+        close(pcm);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,114 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+//
+// Layout of the shared memory frame ring, as written by catdv --shm and read by catdv-shmread.
+//
+// The producer owns writeIndex, each reader owns its readIndex. These only ever increase, and slot
+// 'n' is at n%slotCount. The producer will not overwrite a slot until every live reader has read
+// it. writeSeq and readSeq are futex words, bumped (and woken) whenever writeIndex or a readIndex
+// changes.
+namespace Shm
+{
+    static const char     constMagic[8]={ 'C', 'A', 'T', 'D', 'V', 'S', 'H', 'M' };
+    static const uint32_t constVersion=1;
+    static const int      constMaxReaders=8;
+    static const int      constSlotCount=16;
+    static const int      constMaxVideoSize=720*576*3/2;
+    static const int      constMaxAudioSize=1944*4*2; // Max samples per frame * max channels * 16 bit
+
+    struct Reader
+    {
+        int32_t  pid;           // 0 - unused, <0 - being claimed
+        uint32_t pad;
+        uint64_t readIndex;
+    };
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version,
+                 headerSize,
+                 slotCount,
+                 slotSize;
+        int32_t  producer;      // pid
+        uint32_t ready,         // Set once the stream info below is valid
+                 eof,
+                 writeSeq,
+                 readSeq,
+                 width,
+                 height,
+                 audioRate,
+                 audioChannels;
+        char     y4mHeader[128];
+        uint64_t writeIndex;
+        Reader   readers[constMaxReaders];
+    };
+
+    //
+    // Each slot starts with this, followed by the Y, Cb and Cr planes and then interleaved 16 bit PCM
+    struct Slot
+    {
+        uint64_t frame;
+        uint32_t videoSize,
+                 audioSize;
+    };
+
+    inline uint32_t slotSize()
+    {
+        return ((sizeof(Slot)+constMaxVideoSize+constMaxAudioSize+4095)/4096)*4096;
+    }
+
+    inline size_t totalSize(const Header *h)
+    {
+        return h->headerSize+((size_t)h->slotCount*h->slotSize);
+    }
+
+    inline Slot * slot(Header *h, uint64_t index)
+    {
+        return (Slot *)(((unsigned char *)h)+h->headerSize+((index%h->slotCount)*h->slotSize));
+    }
+
+    inline void futexWait(uint32_t *word, uint32_t val, int ms)
+    {
+        struct timespec ts;
+
+        ts.tv_sec=ms/1000;
+        ts.tv_nsec=(ms%1000)*1000000;
+        syscall(SYS_futex, word, FUTEX_WAIT, val, &ts, 0L, 0);
+    }
+
+    inline void futexWake(uint32_t *word)
+    {
+        __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, word, FUTEX_WAKE, 0x7FFFFFFF, 0L, 0L, 0);
+    }
+}
+
+#endif
@@ -0,0 +1,183 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "ShmSink.h"
+#include "ShmRing.h"
+#include "Frame.h"
+#include "YUV420Extractor.h"
+#include <QtCore/QFile>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+static const int constLivenessCheck=100; // ms
+
+CShmSink::CShmSink(const QString &name)
+        : itsName(name),
+          itsShmName(QFile::encodeName(name.startsWith("/") ? name : QString("/")+name)),
+          itsHeader(0L),
+          itsInput(0L)
+{
+    Shm::Header header;
+
+    memset(&header, 0, sizeof(Shm::Header));
+    memcpy(header.magic, Shm::constMagic, sizeof(header.magic));
+    header.version=Shm::constVersion;
+    header.headerSize=((sizeof(Shm::Header)+4095)/4096)*4096;
+    header.slotCount=Shm::constSlotCount;
+    header.slotSize=Shm::slotSize();
+    header.producer=getpid();
+
+    // Remove any stale ring - readers still attached to it keep their own mapping.
+    shm_unlink(itsShmName.constData());
+
+    int    fd=shm_open(itsShmName.constData(), O_RDWR|O_CREAT|O_EXCL, 0644);
+    size_t size=Shm::totalSize(&header);
+
+    if(-1==fd)
+        return;
+
+    if(0==ftruncate(fd, size))
+    {
+        void *mem=mmap(0L, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if(MAP_FAILED!=mem)
+        {
+            itsHeader=(Shm::Header *)mem;
+            memcpy(itsHeader, &header, sizeof(Shm::Header));
+        }
+    }
+    close(fd);
+
+    if(!itsHeader)
+        shm_unlink(itsShmName.constData());
+}
+
+CShmSink::~CShmSink()
+{
+    if(itsHeader)
+    {
+        if(!itsHeader->eof)
+            Flush();
+        munmap(itsHeader, Shm::totalSize(itsHeader));
+        shm_unlink(itsShmName.constData());
+    }
+    delete [] itsInput;
+}
+
+bool CShmSink::Initialise(Frame &frame)
+{
+    AudioInfo info;
+
+    frame.GetAudioInfo(info);
+    itsHeader->width=frame.GetWidth();
+    itsHeader->height=frame.GetHeight();
+    itsHeader->audioRate=info.frequency;
+    itsHeader->audioChannels=frame.decoder->audio->num_channels;
+    snprintf(itsHeader->y4mHeader, sizeof(itsHeader->y4mHeader), "YUV4MPEG2 W%d H%d F%s Ib%s %s\n",
+             itsHeader->width, itsHeader->height, frame.IsPAL() ? "25:1" : "30000:1001",
+             YUV420Extractor::AspectTag(itsHeader->height, frame.IsWide()),
+             frame.IsPAL() ? "C420paldv" : "C420mpeg2");
+    itsInput=new unsigned char[720 * 576 * 2];
+
+    __atomic_store_n(&itsHeader->ready, 1, __ATOMIC_RELEASE);
+    Shm::futexWake(&itsHeader->writeSeq);
+    return true;
+}
+
+//
+// Decode straight into the next slot, once all readers are done with it.
+bool CShmSink::Output(Frame &frame)
+{
+    if(!waitForSlot())
+        return false;
+
+    uint64_t      index=itsHeader->writeIndex;
+    Shm::Slot     *slot=Shm::slot(itsHeader, index);
+    unsigned char *video=((unsigned char *)slot)+sizeof(Shm::Slot);
+    uint32_t      planeSize=itsHeader->width*itsHeader->height;
+    uint8_t       *planes[3]={ video, video+planeSize, video+planeSize+(planeSize/4) };
+    AudioInfo     info;
+
+    frame.SetPreferredQuality();
+    frame.ExtractYUV420(itsInput, planes);
+    slot->frame=index;
+    slot->videoSize=planeSize*3/2;
+
+    // A corrupt audio header must not make the samples overrun the slot
+    slot->audioSize=frame.GetAudioInfo(info) && info.samples>=0 && info.channels>=0 &&
+                    info.samples*info.channels*2<=Shm::constMaxAudioSize
+                        ? frame.ExtractAudio(video+slot->videoSize) : 0;
+
+    __atomic_store_n(&itsHeader->writeIndex, index+1, __ATOMIC_RELEASE);
+    Shm::futexWake(&itsHeader->writeSeq);
+    return true;
+}
+
+bool CShmSink::Flush()
+{
+    __atomic_store_n(&itsHeader->eof, 1, __ATOMIC_RELEASE);
+    Shm::futexWake(&itsHeader->writeSeq);
+    return true;
+}
+
+//
+// Readers that have exited without detaching are dropped, so they cannot stall the ring. A reader
+// that is still attaching (negative pid) blocks at the readIndex of its entry, which is never ahead of
+// the position it will start from.
+bool CShmSink::waitForSlot()
+{
+    uint64_t index=itsHeader->writeIndex;
+
+    for(;;)
+    {
+        uint32_t seq=__atomic_load_n(&itsHeader->readSeq, __ATOMIC_ACQUIRE);
+        bool     blocked=false;
+
+        for(int r=0; r<Shm::constMaxReaders; ++r)
+        {
+            Shm::Reader *reader=&itsHeader->readers[r];
+            int32_t     pid=__atomic_load_n(&reader->pid, __ATOMIC_ACQUIRE);
+
+            if(0==pid)
+                continue;
+
+            if(0!=kill(pid<0 ? -pid : pid, 0) && ESRCH==errno)
+            {
+                __atomic_compare_exchange_n(&reader->pid, &pid, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+                continue;
+            }
+
+            if(index-__atomic_load_n(&reader->readIndex, __ATOMIC_ACQUIRE)>=itsHeader->slotCount)
+                blocked=true;
+        }
+
+        if(!blocked)
+            return true;
+
+        Shm::futexWait(&itsHeader->readSeq, seq, constLivenessCheck);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef SHM_SINK_H
+#define SHM_SINK_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <stdint.h>
+#include "Sink.h"
+
+class Frame;
+
+namespace Shm
+{
+    struct Header;
+}
+
+//
+// Publishes decoded 4:2:0 planes and PCM into a POSIX shared memory ring (see ShmRing.h), so that
+// several local processes may share one decode.
+class CShmSink : public CSink
+{
+    public:
+
+    CShmSink(const QString &name);
+    ~CShmSink();
+
+    operator bool() const { return 0L!=itsHeader; }
+
+    const QString & name() const { return itsName; }
+    bool            Initialise(Frame &frame);
+    bool            Output(Frame &frame);
+    bool            Flush();
+
+    private:
+
+    bool            waitForSlot();
+
+    private:
+
+    QString        itsName;
+    QByteArray     itsShmName;
+    Shm::Header    *itsHeader;
+    unsigned char  *itsInput;
+};
+
+#endif
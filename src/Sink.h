@@ -0,0 +1,40 @@
+#ifndef SINK_H
+#define SINK_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+class Frame;
+
+//
+// Something that consumes decoded frames. Initialise() is called with the first frame, then
+// Output() with every frame (including the first), and then Flush() at the end.
+class CSink
+{
+    public:
+
+    virtual ~CSink() { }
+
+    virtual bool Initialise(Frame &frame)=0;
+    virtual bool Output(Frame &frame)=0;
+    virtual bool Flush()=0;
+};
+
+#endif
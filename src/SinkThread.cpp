@@ -0,0 +1,166 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "SinkThread.h"
+#include "Sink.h"
+#include "BufferedWriter.h"
+#include <QtCore/QMutexLocker>
+
+static const int constQueueSize=25;
+
+CSinkThread::CSinkThread(CSink *sink, const QString &name, FILE *errorLog, const CBufferedWriter *writer)
+           : itsSink(sink),
+             itsName(name),
+             itsWriter(writer),
+             itsFailure(None),
+             itsFinished(false),
+             itsBusy(false),
+             itsFrames(0),
+             itsBytes(writer ? 0 : -1)
+{
+    itsFrame.decoder->audio->error_log=errorLog;
+    itsFrame.decoder->video->error_log=errorLog;
+}
+
+CSinkThread::~CSinkThread()
+{
+    finish();
+}
+
+CSinkThread::Failure CSinkThread::failure() const
+{
+    QMutexLocker locker(&itsMutex);
+    return itsFailure;
+}
+
+void CSinkThread::position(int64_t &frames, int64_t &bytes) const
+{
+    QMutexLocker locker(&itsMutex);
+    frames=itsFrames;
+    bytes=itsBytes;
+}
+
+void CSinkThread::add(const QByteArray &frame, const CFrameCache::Key &key)
+{
+    QMutexLocker locker(&itsMutex);
+
+    while(itsQueue.count()>=constQueueSize && None==itsFailure)
+        itsNotFull.wait(&itsMutex);
+
+    if(None==itsFailure)
+    {
+        Entry entry;
+
+        entry.frame=frame;
+        entry.key=key;
+        itsQueue.append(entry);
+        itsNotEmpty.wakeOne();
+    }
+}
+
+//
+// Wait for all queued frames to be output, but leave the thread running.
+void CSinkThread::drain()
+{
+    QMutexLocker locker(&itsMutex);
+
+    while((!itsQueue.isEmpty() || itsBusy) && None==itsFailure)
+        itsIdle.wait(&itsMutex);
+}
+
+//
+// Wait for all queued frames to be output, and the sink flushed.
+void CSinkThread::finish()
+{
+    {
+        QMutexLocker locker(&itsMutex);
+        itsFinished=true;
+        itsNotEmpty.wakeOne();
+    }
+    wait();
+}
+
+void CSinkThread::run()
+{
+    bool initialised=false;
+
+    for(;;)
+    {
+        Entry entry;
+
+        {
+            QMutexLocker locker(&itsMutex);
+
+            while(itsQueue.isEmpty() && !itsFinished)
+                itsNotEmpty.wait(&itsMutex);
+            if(itsQueue.isEmpty())
+                break;
+            entry=itsQueue.takeFirst();
+            itsBusy=true;
+            itsNotFull.wakeOne();
+        }
+
+        // libdv only reads the frame, so use constData() to avoid detaching the shared copy
+        itsFrame.data=(unsigned char *)entry.frame.constData();
+        *itsFrame.cache_key=entry.key;
+        itsFrame.ExtractHeader();
+
+        if(!initialised)
+        {
+            if(!itsSink->Initialise(itsFrame))
+            {
+                fail(InitialiseFailed);
+                break;
+            }
+            initialised=true;
+        }
+
+        if(!itsSink->Output(itsFrame))
+        {
+            fail(OutputFailed);
+            break;
+        }
+
+        // The writer is only used by this thread, so the position is copied whilst locked
+        QMutexLocker locker(&itsMutex);
+        itsBusy=false;
+        itsFrames++;
+        if(itsWriter)
+            itsBytes=itsWriter->position();
+        if(itsQueue.isEmpty())
+            itsIdle.wakeAll();
+    }
+
+    if(initialised && !itsSink->Flush())
+        fail(OutputFailed);
+}
+
+//
+// Drop whatever is queued, and wake anything waiting on the queue, as nothing more will be output.
+void CSinkThread::fail(Failure f)
+{
+    QMutexLocker locker(&itsMutex);
+
+    itsFailure=f;
+    itsBusy=false;
+    itsQueue.clear();
+    itsNotFull.wakeAll();
+    itsIdle.wakeAll();
+}
@@ -0,0 +1,100 @@
+#ifndef SINK_THREAD_H
+#define SINK_THREAD_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <stdio.h>
+#include "Frame.h"
+#include "FrameCache.h"
+
+class CSink;
+class CBufferedWriter;
+
+//
+// Runs a sink on its own thread. Raw DV frames are queued as (implicitly shared) QByteArrays, so
+// one copy serves every sink. The queue is bounded - add() blocks whilst it is full, so a slow sink
+// holds back reading but not the other sinks. Each thread has its own Frame, and hence its own
+// libdv decoder. Each frame carries its CFrameCache key.
+class CSinkThread : public QThread
+{
+    public:
+
+    enum Failure
+    {
+        None,
+        InitialiseFailed,
+        OutputFailed
+    };
+
+    //
+    // 'writer' is the file that the sink writes to, if any, and is only used to report its progress.
+    CSinkThread(CSink *sink, const QString &name, FILE *errorLog, const CBufferedWriter *writer=0L);
+    ~CSinkThread();
+
+    const QString & name() const { return itsName; }
+    bool            failed() const { return None!=failure(); }
+    Failure         failure() const;
+    //
+    // The number of frames output so far, and the bytes written - or -1 if there is no writer.
+    void            position(int64_t &frames, int64_t &bytes) const;
+    void            add(const QByteArray &frame, const CFrameCache::Key &key);
+    void            drain();
+    void            finish();
+
+    protected:
+
+    void            run();
+
+    private:
+
+    void            fail(Failure f);
+
+    private:
+
+    struct Entry
+    {
+        QByteArray       frame;
+        CFrameCache::Key key;
+    };
+
+    CSink                 *itsSink;
+    QString               itsName;
+    const CBufferedWriter *itsWriter;
+    Frame                 itsFrame;
+    mutable QMutex        itsMutex;
+    QWaitCondition        itsNotEmpty,
+                          itsNotFull,
+                          itsIdle;
+    QList<Entry>          itsQueue;
+    Failure               itsFailure;
+    bool                  itsFinished,
+                          itsBusy;
+    int64_t               itsFrames,
+                          itsBytes;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "Stream.h"
+#include "Clip.h"
+#include <QtCore/QFile>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+bool CStream::isStream(const QString &name)
+{
+    struct stat64 info;
+
+    return "-"==name || (0==stat64(QFile::encodeName(name).constData(), &info) && S_ISFIFO(info.st_mode));
+}
+
+CStream::CStream(const QString &name)
+       : itsName(name),
+         itsFd("-"==name ? STDIN_FILENO : open64(QFile::encodeName(name).constData(), O_RDONLY)),
+         itsFirstRead(false),
+         itsAtEnd(false)
+{
+    if(-1==itsFd)
+        return;
+
+    // NTSC frames are the smaller, and the DSF bit of the 1st DIF block's header says if it is PAL
+    unsigned char frame[CClip::constPalFrameSize];
+
+    if(CClip::constNtscFrameSize==readFully(frame, CClip::constNtscFrameSize, true))
+    {
+        if(!(frame[3]&0x80))
+            itsFirstFrame=QByteArray((const char *)frame, CClip::constNtscFrameSize);
+        else if(CClip::constPalFrameSize-CClip::constNtscFrameSize==
+                readFully(frame+CClip::constNtscFrameSize, CClip::constPalFrameSize-CClip::constNtscFrameSize, true))
+            itsFirstFrame=QByteArray((const char *)frame, CClip::constPalFrameSize);
+    }
+
+    itsAtEnd=itsFirstFrame.isEmpty();
+}
+
+CStream::~CStream()
+{
+    if(-1!=itsFd && STDIN_FILENO!=itsFd)
+        close(itsFd);
+}
+
+int CStream::read(unsigned char *buffer, int count)
+{
+    if(count<=0 || !isOk())
+        return 0;
+
+    int frames=0;
+
+    if(!itsFirstRead)
+    {
+        memcpy(buffer, itsFirstFrame.constData(), frameSize());
+        itsFirstRead=true;
+        buffer+=frameSize();
+        frames++;
+        count--;
+    }
+
+    if(count && !itsAtEnd)
+    {
+        int64_t size=frameSize(),
+                got=readFully(buffer, count*size, false);
+
+        // Complete the last frame - a partial frame is only dropped at the end of the stream
+        if(got%size)
+        {
+            int64_t rest=size-(got%size);
+
+            got=rest==readFully(buffer+got, rest, true) ? got+rest : got-(got%size);
+        }
+        frames+=got/size;
+    }
+
+    return frames;
+}
+
+//
+// Read until 'size' bytes have been read, or the end of the stream. Unless 'wait' is set, reading
+// stops early once there is nothing more to read without blocking.
+int64_t CStream::readFully(unsigned char *buffer, int64_t size, bool wait)
+{
+    int64_t got=0;
+
+    while(got<size)
+    {
+        ssize_t r=::read(itsFd, buffer+got, size-got);
+
+        if(r<0 && EINTR==errno)
+            continue;
+        if(r<=0)
+        {
+            itsAtEnd=true;
+            break;
+        }
+        got+=r;
+        if(!wait && got<size)
+            break;
+    }
+
+    return got;
+}
@@ -0,0 +1,64 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+
+//
+// Raw DV read from stdin, or a FIFO - e.g. "dvgrab - | catdv - ...". The length is not known, and
+// the data can only be read once, in order. The 1st frame is read when the stream is opened, so
+// that its type may be detected - it is then returned by the 1st read().
+class CStream
+{
+    public:
+
+    static bool isStream(const QString &name);
+
+    CStream(const QString &name);
+    ~CStream();
+
+    bool                  isOk() const       { return !itsFirstFrame.isEmpty(); }
+    bool                  atEnd() const      { return itsAtEnd; }
+    const QString &       name() const       { return itsName; }
+    int                   frameSize() const  { return itsFirstFrame.size(); }
+    const unsigned char * firstFrame() const { return (const unsigned char *)itsFirstFrame.constData(); }
+
+    //
+    // Reads up to 'count' frames, but returns as soon as the frames that have arrived so far have
+    // been read - so that output keeps up with a live capture. Returns the number of frames read.
+    int                   read(unsigned char *buffer, int count);
+
+    private:
+
+    int64_t               readFully(unsigned char *buffer, int64_t size, bool wait);
+
+    private:
+
+    QString    itsName;
+    int        itsFd;
+    QByteArray itsFirstFrame;
+    bool       itsFirstRead,
+               itsAtEnd;
+};
+
+#endif
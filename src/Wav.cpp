@@ -24,10 +24,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <endian.h>
 #include "Wav.h"
 
-Wav::Wav(CBufferedWriter &file)
-           : f(file)
+Wav::Wav(CBufferedWriter &file, int r, bool p)
+           : f(file), resampler(NULL), rate(r), polyphase(p)
 {
     memset( &header, 0, sizeof( WAVHeader ) );
 }
@@ -49,6 +50,33 @@ void Wav::SetInfo( int16_t channels, int rate, int bytespersample )
     memcpy( header.data, "data", 4 );
 }
 
+static uint8_t *Put( uint8_t *buffer, uint32_t v, int bytes )
+{
+    for ( int i = 0; i < bytes; i ++, v >>= 8 )
+        *buffer ++ = ( uint8_t )v;
+    return buffer;
+}
+
+/** Build a complete, little endian, 16 bit PCM header - the same as WriteHeader( ) produces.
+*/
+void Wav::MakeHeader( uint8_t *buffer, int16_t channels, int rate, uint32_t data_length )
+{
+    uint8_t *b = buffer;
+
+    memcpy( b, "RIFF", 4 );
+    b = Put( b + 4, 36 + data_length, 4 );
+    memcpy( b, "WAVEfmt ", 8 );
+    b = Put( b + 8, 0x10, 4 );
+    b = Put( b, 0x01, 2 );
+    b = Put( b, channels, 2 );
+    b = Put( b, rate, 4 );
+    b = Put( b, rate * channels * 2, 4 );
+    b = Put( b, channels * 2, 2 );
+    b = Put( b, 16, 2 );
+    memcpy( b, "data", 4 );
+    Put( b + 4, data_length, 4 );
+}
+
 int Wav::WriteHeader( )
 {
     int bytes;
@@ -95,6 +123,10 @@ int Wav::Write( int16_t v)
 
 int Wav::Write( int16_t *values, int length )
 {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    // Samples are already in WAV byte order, so write as a block
+    return f.write( ( unsigned char * )values, length * 2 ) ? length * 2 : 0;
+#else
     int index = 0;
     int bytes = 0;
 
@@ -103,6 +135,7 @@ int Wav::Write( int16_t *values, int length )
                  Write( ( uint8_t )( values[ index ] >> 8 ) );
 
     return bytes;
+#endif
 }
 
 int Wav::Write( uint8_t *data, int size )
@@ -116,8 +149,21 @@ bool Wav::Initialise( Frame &frame )
     {
         AudioInfo info;
         frame.GetAudioInfo( info );
-        SetInfo( ( int16_t )frame.decoder->audio->num_channels, info.frequency, 2 );
-        resampler = new FastAudioResample( info.frequency );
+        if ( rate <= 0 )
+            rate = info.frequency;
+        SetInfo( ( int16_t )frame.decoder->audio->num_channels, rate, 2 );
+        if ( polyphase )
+            resampler = new PolyphaseAudioResample( rate );
+        else
+            resampler = new FastAudioResample( rate );
+        if ( f.resumed( ) )
+        {
+            // A resumed file already has its header, which Flush( ) updates with the full length
+            uint32_t length = f.position( ) - HeaderSize;
+            header.data_length += length;
+            header.riff_length += length;
+            return true;
+        }
         return WriteHeader( ) != 0;
     }
     else
@@ -132,7 +178,7 @@ bool Wav::Output( Frame &frame )
 
 bool Wav::Flush( )
 {
-    if (f.seekToStart())
-        WriteHeader( );
-    return true;
+    if (f.seekToStart() && 0 == WriteHeader( ))
+        return false;
+    return f.flush( );
 }
@@ -24,6 +24,7 @@
 
 #include "Frame.h"
 #include "BufferedWriter.h"
+#include "Sink.h"
 
 typedef struct WavHeader
 {
@@ -43,17 +44,23 @@ typedef struct WavHeader
 }
 WAVHeaderType, *WAVHeader;
 
-class Wav
+class Wav : public CSink
 {
     private:
 
     struct WavHeader header;
     CBufferedWriter  &f;
     AudioResample    *resampler;
+    int              rate;
+    bool             polyphase;
     
     public:
     
-    Wav( CBufferedWriter &file );
+    Wav( CBufferedWriter &file, int rate = 0, bool polyphase = false );
+
+    // For writers that know the data length up front
+    enum { HeaderSize = 44 };
+    static void MakeHeader( uint8_t *buffer, int16_t channels, int rate, uint32_t data_length );
 
     void SetInfo( int16_t channels, int rate, int bytespersample );
     int WriteHeader( );
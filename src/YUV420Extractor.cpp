@@ -13,12 +13,15 @@ using std::string;
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "YUV420Extractor.h"
 #include "Frame.h"
 #include "BufferedWriter.h"
+#include "FormatTraits.h"
+#include "Kernels.h"
 
-static const char *aspect_tag(int height, bool wide)
+const char *YUV420Extractor::AspectTag(int height, bool wide)
 {
     if (height == 576) 
     {
@@ -37,18 +40,18 @@ static const char *aspect_tag(int height, bool wide)
 }
 
 /** Extracts the YUV frames and outputs them.
+    Templated on the DV system (see FormatTraits.h), so that width and height are constants.
 */
-static char header[128];
 
-class ExtendedYUV420Extractor : public YUV420Extractor
+template <class F> class ExtendedYUV420Extractor : public YUV420Extractor
 {
     public:
-        ExtendedYUV420Extractor(CBufferedWriter &out) : YUV420Extractor(out) { }
+        ExtendedYUV420Extractor(CBufferedWriter *out) : YUV420Extractor(out) { }
 
         bool Initialise( Frame &frame )
         {
-            width = frame.GetWidth( );
-            height = frame.GetHeight( );
+            if ( frame.IsPAL( ) != F::constPal )
+                return false;
 
             pitches[ 0 ] = width * 2;
             pitches[ 1 ] = 0;
@@ -60,14 +63,16 @@ class ExtendedYUV420Extractor : public YUV420Extractor
 
 // Define space for a uncompressed YUV422 PAL frame (being the maxiumum)
 //  NOTE: uncompressed 4:2:2 is 720*576*2 not 720*576*4 - why waste space?
-            input = new uint8_t[720 * 576 * 2];
+//  ...but the crufty deinterlacer decodes RGB into it, which is 720*576*3
+            input = new uint8_t[720 * 576 * 3];
 
             // Output the header
             sprintf(header, "YUV4MPEG2 W%d H%d F%s Ib%s %s\n",
-                    width, height, height == 576 ? "25:1" : "30000:1001",
-                    aspect_tag(height, frame.IsWide()),
-                    height == 576 ? "C420paldv" : "C420mpeg2");
-            f.write((unsigned char *)header, strlen(header));
+                    width, height, F::frameRate(),
+                    AspectTag(height, frame.IsWide()),
+                    F::chroma());
+            if ( f && !f->resumed() ) // A resumed file already has its header
+                f->write((unsigned char *)header, strlen(header));
             /*
             std::cout << "YUV4MPEG2 W" << width 
                       << " H" << height 
@@ -82,12 +87,25 @@ class ExtendedYUV420Extractor : public YUV420Extractor
 
         bool Output( Frame &frame )
         {
-            Extract( frame );
+            // Decode straight into the writer's buffer, if possible
+            unsigned int size = 6 + width * height * 3 / 2;
+            unsigned char *dest = f->reserve( size );
+
+            if ( dest )
+            {
+                uint8_t *planes[ 3 ] = { dest + 6, dest + 6 + width * height, dest + 6 + width * height * 5 / 4 };
+
+                memcpy( dest, "FRAME\n", 6 );
+                Extract( frame, planes );
+                return f->commit( size );
+            }
+
+            Extract( frame, output );
             //std::cout << "FRAME" << std::endl;
-            return f.write((unsigned char *)"FRAME\n", 6) &&
-                   f.write( output[0], width * height) &&
-                   f.write( output[1], width * height / 4) &&
-                   f.write( output[2], width * height / 4);
+            return f->write((unsigned char *)"FRAME\n", 6) &&
+                   f->write( output[0], width * height) &&
+                   f->write( output[1], width * height / 4) &&
+                   f->write( output[2], width * height / 4);
         }
 
         bool Flush( )
@@ -96,86 +114,49 @@ class ExtendedYUV420Extractor : public YUV420Extractor
             delete output[ 1 ];
             delete output[ 2 ];
             delete input;
-            return true;
+            return !f || f->flush( );
         }
 
     protected:
 
-        int width;
-        int height;
+        static const int width = F::constWidth;
+        static const int height = F::constHeight;
         int pitches[ 3 ];
         uint8_t *output[ 3 ];
         uint8_t *input;
 
-        virtual void Extract( Frame &frame )
+        virtual void Extract( Frame &frame, uint8_t *planes[ 3 ] )
         {
-            frame.decoder->quality = DV_QUALITY_BEST;
-            frame.ExtractYUV420( input, output );
+            frame.SetPreferredQuality( );
+            frame.ExtractYUV420<F>( input, planes );
         }
 };
 
-/** Provides deinterlaced output.
+/** Provides deinterlaced output - by using only the first field, each of its lines doubled.
 */
 
-#define SCALEBITS 8
-#define ONE_HALF  (1 << (SCALEBITS - 1))
-#define FIX(x)        ((int) ((x) * (1L<<SCALEBITS) + 0.5))
-
-class ExtendedYUV420CruftyExtractor : public ExtendedYUV420Extractor
+template <class F> class ExtendedYUV420CruftyExtractor : public ExtendedYUV420Extractor<F>
 {
     public:
-        ExtendedYUV420CruftyExtractor(CBufferedWriter &out) : ExtendedYUV420Extractor(out) { }
+        ExtendedYUV420CruftyExtractor(CBufferedWriter *out) : ExtendedYUV420Extractor<F>(out) { }
 
-        virtual void Extract( Frame &frame )
+        virtual void Extract( Frame &frame, uint8_t *planes[ 3 ] )
         {
-            int r, g, b, r1, g1, b1;
+            static const int width = F::constWidth;
+            static const int height = F::constHeight;
+            uint8_t *input = this->input;
 
-            frame.decoder->quality = DV_QUALITY_BEST;
+            frame.SetPreferredQuality( );
 
             frame.ExtractRGB( input );
 
-            uint8_t *lum = output[0];
-            uint8_t *cb = output[1];
-            uint8_t *cr = output[2];
-
-            int wrap = width;
-            int wrap3 = width * 3;
-            uint8_t *p = input;
-
-            for( int y = 0; y < height; y += 2 ) 
+            // The line conversion is in Kernels, for each instruction set
+            for ( int y = 0; y < height; y += 2 )
             {
-                for( int x = 0; x < width; x += 2 ) 
-                {
-                    r = p[0];
-                    g = p[1];
-                    b = p[2];
-                    r1 = r;
-                    g1 = g;
-                    b1 = b;
-                    lum[width] = lum[0] = (FIX(0.29900) * r + FIX(0.58700) * g + 
-                              FIX(0.11400) * b + ONE_HALF) >> SCALEBITS;
-                    r = p[3];
-                    g = p[4];
-                    b = p[5];
-                    r1 += r;
-                    g1 += g;
-                    b1 += b;
-                    lum[width + 1] = lum[1] = (FIX(0.29900) * r + FIX(0.58700) * g + 
-                              FIX(0.11400) * b + ONE_HALF) >> SCALEBITS;
-                    lum += wrap;
-        
-                    cb[0] = ((- FIX(0.16874) * r1 - FIX(0.33126) * g1 + 
-                              FIX(0.50000) * b1 + 4 * ONE_HALF - 1) >> (SCALEBITS + 1)) + 128;
-                    cr[0] = ((FIX(0.50000) * r1 - FIX(0.41869) * g1 - 
-                             FIX(0.08131) * b1 + 4 * ONE_HALF - 1) >> (SCALEBITS + 1)) + 128;
-
-                    cb++;
-                    cr++;
-                    p += 6;
-                    lum += -wrap + 2;
-                }
-                p += wrap3;
-                lum += wrap;
+                uint8_t *lum = planes[ 0 ] + y * width;
+
+                Kernels::rgbToYuv( input + y * width * 3, lum, planes[ 1 ] + y / 2 * width / 2, planes[ 2 ] + y / 2 * width / 2, width );
+                memcpy( lum + width, lum, width );
             }
         }
 };
@@ -185,16 +166,16 @@ class ExtendedYUV420CruftyExtractor : public ExtendedYUV420Extractor
  * Note: ONLY for NTSC DV material!
  *
  */
-class ExtendedYUV411Extractor : public YUV420Extractor
+template <class F> class ExtendedYUV411Extractor : public YUV420Extractor
 {
     public:
 
-        ExtendedYUV411Extractor(CBufferedWriter &out) : YUV420Extractor(out) { }
+        ExtendedYUV411Extractor(CBufferedWriter *out) : YUV420Extractor(out) { }
 
         bool Initialise( Frame &frame )
         {
-            width = frame.GetWidth( );
-            height = frame.GetHeight( );
+            if ( frame.IsPAL( ) != F::constPal )
+                return false;
     
             pitches[ 0 ] = width * 2;
             pitches[ 1 ] = 0;
@@ -212,8 +193,9 @@ class ExtendedYUV411Extractor : public YUV420Extractor
             // Output the header.  4:1:1 is specific to NTSC so
             //  it is silly to check for PAL frame size and rate.
             sprintf(header, "YUV4MPEG2 W%d H%d F30000:1001 Ib%s C411\n",
-                    width, height, aspect_tag(height, frame.IsWide()));
-            f.write((unsigned char *)header, strlen(header));
+                    width, height, AspectTag(height, frame.IsWide()));
+            if ( f && !f->resumed() ) // A resumed file already has its header
+                f->write((unsigned char *)header, strlen(header));
             /*
             std::cout << "YUV4MPEG2 W" << width 
                        << " H" << height 
@@ -228,12 +210,25 @@ class ExtendedYUV411Extractor : public YUV420Extractor
   
         bool Output( Frame &frame )
         {
-            Extract( frame );
+            // Decode straight into the writer's buffer, if possible
+            unsigned int size = 6 + width * height * 3 / 2;
+            unsigned char *dest = f->reserve( size );
+
+            if ( dest )
+            {
+                uint8_t *planes[ 3 ] = { dest + 6, dest + 6 + width * height, dest + 6 + width * height * 5 / 4 };
+
+                memcpy( dest, "FRAME\n", 6 );
+                Extract( frame, planes );
+                return f->commit( size );
+            }
+
+            Extract( frame, output );
             //std::cout << "FRAME" << std::endl;
-            return f.write((unsigned char *)"FRAME\n", 6) &&
-                   f.write( output[0], width * height) &&
-                   f.write( output[1], width * height / 4) &&
-                   f.write( output[2], width * height / 4);
+            return f->write((unsigned char *)"FRAME\n", 6) &&
+                   f->write( output[0], width * height) &&
+                   f->write( output[1], width * height / 4) &&
+                   f->write( output[2], width * height / 4);
         }
   
         bool Flush( )
@@ -242,25 +237,25 @@ class ExtendedYUV411Extractor : public YUV420Extractor
             delete output[ 1 ];
             delete output[ 2 ];
             delete input;
-            return true;
+            return !f || f->flush( );
         }
 
     protected:
-        int width;
-        int height;
+        static const int width = F::constWidth;
+        static const int height = F::constHeight;
         int pitches[3];
         uint8_t *output[3];
         uint8_t *input;
   
-        virtual void Extract(Frame &frame)
+        virtual void Extract(Frame &frame, uint8_t *planes[ 3 ])
         {
-            frame.decoder->quality = DV_QUALITY_BEST;
+            frame.SetPreferredQuality( );
             frame.ExtractYUV( input );
 
             int w4 = width / 4;
-            uint8_t *y = output[0];
-            uint8_t *cb = output[1];
-            uint8_t *cr = output[2];
+            uint8_t *y = planes[0];
+            uint8_t *cb = planes[1];
+            uint8_t *cr = planes[2];
             uint8_t *p = input;
 
             for (int i = 0; i < height; i++) 
@@ -288,23 +283,29 @@ class ExtendedYUV411Extractor : public YUV420Extractor
 /** Factory method to obtain the image extractor.
 */
 
-YUV420Extractor *YUV420Extractor::GetExtractor( CBufferedWriter &out, int deinterlace_type )
+template <class F> static YUV420Extractor *CreateExtractor( CBufferedWriter *out, int deinterlace_type )
 {
     YUV420Extractor *extractor = NULL;
 
     switch ( deinterlace_type )
     {
         case 1:
-            extractor = new ExtendedYUV420CruftyExtractor( out );
+            extractor = new ExtendedYUV420CruftyExtractor<F>( out );
             break;
         case 2:
-            extractor = new ExtendedYUV411Extractor( out );
+            extractor = new ExtendedYUV411Extractor<F>( out );
             break;
         case 0:
         default:
-            extractor = new ExtendedYUV420Extractor( out );
+            extractor = new ExtendedYUV420Extractor<F>( out );
             break;
     }
 
     return extractor;
 }
+
+YUV420Extractor *YUV420Extractor::GetExtractor( CBufferedWriter *out, bool pal, int deinterlace_type )
+{
+    return pal ? CreateExtractor<CPalFormat>( out, deinterlace_type )
+               : CreateExtractor<CNtscFormat>( out, deinterlace_type );
+}
@@ -20,6 +20,9 @@
 #ifndef _YUV420_EXTRACTOR_
 #define _YUV420_EXTRACTOR_
 
+#include "Sink.h"
+#include <stdint.h>
+
 class Frame;
 class CBufferedWriter;
 
@@ -28,21 +31,29 @@ class CBufferedWriter;
     deinterlacing type requested.
 */
 
-class YUV420Extractor
+class YUV420Extractor : public CSink
 {
     public:
 
-    static YUV420Extractor *GetExtractor( CBufferedWriter &out, int deinterlace_type = 0 );
+    // 'out' may be NULL, in which case only Initialise() and Extract() may be used. 'pal' selects
+    // the format the extractor is compiled for - Initialise() fails for a frame of the other one.
+    static YUV420Extractor *GetExtractor( CBufferedWriter *out, bool pal, int deinterlace_type = 0 );
+    static const char *AspectTag( int height, bool wide );
 
-    YUV420Extractor(CBufferedWriter &out) : f(out) { }
+    YUV420Extractor(CBufferedWriter *out) : f(out) { header[0] = '\0'; }
 
     virtual bool Initialise( Frame & ) = 0;
     virtual bool Output( Frame & ) = 0;
     virtual bool Flush( ) = 0;
 
+    // Decode into the 3 planes, and the stream header - valid after Initialise()
+    virtual void Extract( Frame &frame, uint8_t *planes[ 3 ] ) = 0;
+    const char *Header( ) const { return header; }
+
     protected:
 
-    CBufferedWriter &f;
+    CBufferedWriter *f;
+    char header[ 128 ];
 };
 
 #endif
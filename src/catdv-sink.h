@@ -0,0 +1,96 @@
+#ifndef CATDV_SINK_H
+#define CATDV_SINK_H
+
+/*
+  catdv (C) Craig Drummond, 2007 craig.p.drummond@gmail.com
+
+  ----
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public
+  License version 2 as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+/*
+  Output sink plugin interface. A plugin is a shared library exporting:
+
+    const CatdvSink * catdv_sink_entry(void);
+
+  and is loaded with catdv --sink <library>[:<args>]. Each frame is decoded once, and every plugin
+  is then handed const views of the raw DV frame, the decoded 4:2:0 planes and the interleaved 16
+  bit PCM. These views are only valid for the duration of the frame() call.
+
+  The major version must match that of catdv, a plugin built against an older minor version will
+  still load.
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CATDV_SINK_VERSION_MAJOR 1
+#define CATDV_SINK_VERSION_MINOR 0
+#define CATDV_SINK_VERSION       ((CATDV_SINK_VERSION_MAJOR<<16)|CATDV_SINK_VERSION_MINOR)
+#define CATDV_SINK_ENTRY         "catdv_sink_entry"
+
+/* What a sink needs decoding - the raw DV frame is always available. */
+#define CATDV_SINK_WANTS_VIDEO   0x01
+#define CATDV_SINK_WANTS_AUDIO   0x02
+
+typedef struct CatdvStreamInfo
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps_num;
+    uint32_t fps_den;
+    int32_t  pal;
+    int32_t  wide;
+    uint32_t audio_rate;
+    uint32_t audio_channels;
+} CatdvStreamInfo;
+
+typedef struct CatdvFrameView
+{
+    uint64_t       frame;           /* Frame number, starting at 0 */
+    const uint8_t  *dv;             /* Raw DV frame */
+    uint32_t       dv_size;
+    const uint8_t  *planes[3];      /* Y, Cb, Cr - NULL unless CATDV_SINK_WANTS_VIDEO */
+    uint32_t       strides[3];
+    const int16_t  *pcm;            /* Interleaved - NULL unless CATDV_SINK_WANTS_AUDIO */
+    uint32_t       pcm_samples;     /* Per channel */
+    uint32_t       pcm_channels;
+    uint32_t       pcm_rate;
+} CatdvFrameView;
+
+typedef struct CatdvSink
+{
+    uint32_t   version;             /* CATDV_SINK_VERSION */
+    const char *name;
+    uint32_t   wants;               /* CATDV_SINK_WANTS_* */
+
+    /* Return a context passed to the other calls, or NULL on failure */
+    void * (*open)(const char *args, const CatdvStreamInfo *info);
+    /* Return 0 on success */
+    int    (*frame)(void *ctx, const CatdvFrameView *view);
+    int    (*close)(void *ctx);
+} CatdvSink;
+
+typedef const CatdvSink * (*CatdvSinkEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif